@@ -0,0 +1,164 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include "FMBatch.hpp"
+#include "FMPartition.hpp"
+
+namespace FMPartition {
+
+std::vector<BatchJob> read_batch_manifest(const std::string& manifest_file) {
+  std::ifstream ifs;
+  ifs.open(manifest_file);
+
+  if (!ifs) {
+    throw std::runtime_error("failed to open manifest file.");
+  }
+
+  std::vector<BatchJob> jobs;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    BatchJob job;
+    if (!(iss >> job.input_file) || job.input_file[0] == '#') {
+      continue;
+    }
+    if (!(iss >> job.output_file)) {
+      throw std::runtime_error("manifest line without output file: " + line);
+    }
+    
+    std::error_code ec;
+    job.size = std::filesystem::file_size(job.input_file, ec);
+    if (ec) {
+      job.size = 0;
+    }
+    jobs.push_back(job);
+  }
+
+  return jobs;
+}
+
+void run_batch(std::vector<BatchJob>& jobs, const BatchOptions& options) {
+  // largest first, so a big job doesn't
+  // start last and keep one worker busy alone
+  std::vector<size_t> order(jobs.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return jobs[a].size > jobs[b].size;
+  });
+
+  int threads = options.threads;
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min<int>(threads, std::max<size_t>(1, jobs.size()));
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    // kept across jobs, a job too big for its
+    // index types gets a wider engine of its own
+    BasicFMPartition<NarrowIndex> narrow;
+
+    while (true) {
+      size_t i = next.fetch_add(1);
+      if (i >= order.size()) {
+        break;
+      }
+      BatchJob& job = jobs[order[i]];
+
+      auto load = [&](auto& fm) {
+        fm.reset();
+        fm.large_net_threshold = options.large_net_threshold;
+        // the jobs already keep every core busy
+        fm.parse_threads = 1;
+        fm.parallel_write = false;
+        if (options.time_limit > 0) {
+          fm.set_time_limit(options.time_limit);
+        }
+        fm.read_netlist_file(job.input_file);
+      };
+
+      auto run = [&](auto& fm) {
+        if (options.preprocess) {
+          fm.preprocess_netlist();
+        }
+        job.cut = fm.fm_full_pass();
+        job.cells = fm.cell_count;
+        job.nets = fm.net_count;
+        fm.write_result(job.output_file);
+
+        std::ostringstream report;
+        if (options.verify && !fm.verify_result(job.output_file, report)) {
+          // the first message says what's wrong
+          job.error = "verify: " + report.str().substr(0, report.str().find('\n'));
+        }
+      };
+
+      auto start = std::chrono::steady_clock::now();
+      try {
+        bool fits = true;
+        try {
+          load(narrow);
+        }
+        catch (const IndexOverflow&) {
+          fits = false;
+        }
+        if (fits) {
+          run(narrow);
+        }
+        else {
+          with_fitting_engine<WidePinIndex>(load, run);
+        }
+      }
+      catch (const std::exception& e) {
+        job.error = e.what();
+      }
+      std::chrono::duration<double, std::milli> elapsed = 
+        std::chrono::steady_clock::now() - start;
+      job.ms = elapsed.count();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : pool) {
+    t.join();
+  }
+}
+
+void write_batch_summary(std::ostream& os, const std::vector<BatchJob>& jobs) {
+  os << std::left 
+     << std::setw(40) << "input" << " "
+     << std::setw(10) << "cells" << " "
+     << std::setw(10) << "nets" << " "
+     << std::setw(10) << "cut" << " "
+     << std::setw(12) << "ms" << " "
+     << "status\n";
+
+  int failed = 0;
+  double total_ms = 0;
+  for (const auto& job : jobs) {
+    os << std::setw(40) << job.input_file << " "
+       << std::setw(10) << job.cells << " "
+       << std::setw(10) << job.nets << " "
+       << std::setw(10) << job.cut << " "
+       << std::setw(12) << job.ms << " "
+       << (job.error.empty() ? "ok" : job.error) << "\n";
+    
+    failed += !job.error.empty();
+    total_ms += job.ms;
+  }
+
+  os << "jobs: " << jobs.size() << ", failed: " << failed 
+     << ", total job time: " << total_ms << " ms\n";
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+
+namespace FMPartition {
+
+struct BatchJob {
+  std::string input_file;
+  std::string output_file;
+  // input size in bytes, the scheduler
+  // hands out the largest jobs first
+  unsigned long long size = 0;
+
+  long long cells = 0, nets = 0;
+  long long cut = 0;
+  double ms = 0;
+  // empty if the job went fine
+  std::string error;
+};
+
+struct BatchOptions {
+  // 0 means one per hardware thread
+  int threads = 0;
+  int large_net_threshold = 0;
+  // per job, 0 means no limit
+  double time_limit = 0;
+  // run preprocess_netlist() before partitioning
+  bool preprocess = true;
+  // check every output with verify_result(),
+  // a failed check becomes the job's error
+  bool verify = false;
+};
+
+// manifest: one job per line, "input_file output_file",
+// empty lines and lines starting with # are skipped
+std::vector<BatchJob> read_batch_manifest(const std::string& manifest_file);
+
+// partitions every job on a pool of worker threads,
+// each worker keeps one narrow engine and reset()s it
+// between jobs (a job too big for it gets a wider one
+// of its own), results are written with write_result
+void run_batch(std::vector<BatchJob>& jobs, const BatchOptions& options);
+
+// one row per job, in manifest order
+void write_batch_summary(std::ostream& os, const std::vector<BatchJob>& jobs);
+
+}
@@ -0,0 +1,251 @@
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FMCheckpoint.hpp"
+#include "FMPartition.hpp"
+
+namespace FMPartition {
+
+namespace {
+
+const char checkpoint_magic[4] = {'F', 'M', 'C', 'K'};
+// 2: cell count and cuts are 64-bit
+const std::uint32_t checkpoint_version = 2;
+
+// plain values in host byte order, a checkpoint
+// is read back on the machine (cluster) that wrote it
+template <typename T>
+void put(std::vector<char>& buf, const T& value) {
+  const char* p = reinterpret_cast<const char*>(&value);
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+void put_partition(std::vector<char>& buf, const std::vector<int>& partition) {
+  size_t start = buf.size();
+  buf.resize(start + (partition.size() + 7) / 8, 0);
+  for (size_t c = 0; c < partition.size(); c++) {
+    if (partition[c]) {
+      buf[start + c / 8] |= 1 << (c % 8);
+    }
+  }
+}
+
+class Reader {
+public:
+  Reader(const std::vector<char>& buf) : _buf(buf) {}
+
+  template <typename T>
+  T get() {
+    T value;
+    std::memcpy(&value, _take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::vector<int> get_partition(std::int64_t cell_count) {
+    if (cell_count < 0) {
+      throw std::runtime_error("corrupt checkpoint.");
+    }
+    const char* bits = _take((cell_count + 7) / 8);
+    std::vector<int> partition(cell_count);
+    for (std::int64_t c = 0; c < cell_count; c++) {
+      partition[c] = (bits[c / 8] >> (c % 8)) & 1;
+    }
+    return partition;
+  }
+
+private:
+  const char* _take(size_t n) {
+    if (_buf.size() - _pos < n) {
+      throw std::runtime_error("truncated checkpoint.");
+    }
+    const char* p = _buf.data() + _pos;
+    _pos += n;
+    return p;
+  }
+
+  const std::vector<char>& _buf;
+  size_t _pos = 0;
+};
+
+}
+
+template <typename Index>
+std::uint64_t netlist_fingerprint(const BasicFMPartition<Index>& fm) {
+  // FNV-1a over whole ids, widened to 64 bits
+  std::uint64_t h = 14695981039346656037ULL;
+  auto mix = [&h](std::uint64_t x) {
+    h = (h ^ x) * 1099511628211ULL;
+  };
+  mix(fm.cell_count);
+  mix(fm.net_count);
+  for (auto offset : fm.net_offsets) {
+    mix(offset);
+  }
+  for (auto c : fm.net_pins) {
+    mix(c);
+  }
+  return h;
+}
+
+template std::uint64_t netlist_fingerprint(const BasicFMPartition<NarrowIndex>&);
+template std::uint64_t netlist_fingerprint(const BasicFMPartition<WidePinIndex>&);
+template std::uint64_t netlist_fingerprint(const BasicFMPartition<WideIndex>&);
+
+std::vector<char> serialize_checkpoint(const Checkpoint& checkpoint) {
+  std::vector<char> buf(checkpoint_magic, checkpoint_magic + 4);
+  put(buf, checkpoint_version);
+  put(buf, checkpoint.mode);
+  put(buf, checkpoint.fingerprint);
+  put(buf, checkpoint.cell_count);
+  put(buf, checkpoint.passes);
+  put(buf, checkpoint.elapsed);
+  put(buf, checkpoint.resumes);
+  put(buf, checkpoint.cut);
+  put_partition(buf, checkpoint.partition);
+
+  if (checkpoint.mode == Checkpoint::Mode::MEMETIC) {
+    put(buf, checkpoint.starts);
+    put(buf, checkpoint.offspring);
+    put(buf, checkpoint.improvements);
+    put(buf, checkpoint.best_start_cut);
+    put(buf, static_cast<int>(checkpoint.population.size()));
+    for (size_t i = 0; i < checkpoint.population.size(); i++) {
+      put(buf, checkpoint.population_cuts[i]);
+      put_partition(buf, checkpoint.population[i]);
+    }
+  }
+  return buf;
+}
+
+Checkpoint read_checkpoint(const std::string& checkpoint_file) {
+  std::ifstream ifs(checkpoint_file, std::ios::binary);
+  if (!ifs) {
+    throw std::runtime_error("cannot open checkpoint " + checkpoint_file + ".");
+  }
+  std::vector<char> buf((std::istreambuf_iterator<char>(ifs)),
+    std::istreambuf_iterator<char>());
+
+  if (buf.size() < 4 || std::memcmp(buf.data(), checkpoint_magic, 4) != 0) {
+    throw std::runtime_error(checkpoint_file + " is not a checkpoint.");
+  }
+
+  Reader reader(buf);
+  reader.get<std::uint32_t>();
+  if (reader.get<std::uint32_t>() != checkpoint_version) {
+    throw std::runtime_error(checkpoint_file + " has an unknown version.");
+  }
+
+  Checkpoint checkpoint;
+  checkpoint.mode = reader.get<Checkpoint::Mode>();
+  checkpoint.fingerprint = reader.get<std::uint64_t>();
+  checkpoint.cell_count = reader.get<std::int64_t>();
+  checkpoint.passes = reader.get<int>();
+  checkpoint.elapsed = reader.get<double>();
+  checkpoint.resumes = reader.get<int>();
+  checkpoint.cut = reader.get<std::int64_t>();
+  checkpoint.partition = reader.get_partition(checkpoint.cell_count);
+
+  if (checkpoint.mode == Checkpoint::Mode::MEMETIC) {
+    checkpoint.starts = reader.get<int>();
+    checkpoint.offspring = reader.get<int>();
+    checkpoint.improvements = reader.get<int>();
+    checkpoint.best_start_cut = reader.get<std::int64_t>();
+    int population_size = reader.get<int>();
+    for (int i = 0; i < population_size; i++) {
+      checkpoint.population_cuts.push_back(reader.get<std::int64_t>());
+      checkpoint.population.push_back(reader.get_partition(checkpoint.cell_count));
+    }
+  }
+  return checkpoint;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& checkpoint_file, double interval) :
+  _file(checkpoint_file),
+  _interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(interval))),
+  _last_offer(std::chrono::steady_clock::now()),
+  _thread(&CheckpointWriter::_run, this)
+{
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  close();
+}
+
+void CheckpointWriter::close() {
+  if (!_thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_one();
+  _thread.join();
+}
+
+bool CheckpointWriter::due() const {
+  return std::chrono::steady_clock::now() - _last_offer >= _interval;
+}
+
+void CheckpointWriter::offer(const Checkpoint& checkpoint) {
+  // packing is cheap next to the write, so it
+  // stays on the caller and the thread only
+  // ever sees finished bytes
+  std::vector<char> buf = serialize_checkpoint(checkpoint);
+  _last_offer = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending.swap(buf);
+    _has_pending = true;
+  }
+  _cv.notify_one();
+}
+
+std::string CheckpointWriter::error() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _error;
+}
+
+void CheckpointWriter::_run() {
+  std::string tmp_file = _file + ".tmp";
+  std::vector<char> buf;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [this]() { return _has_pending || _stop; });
+      if (!_has_pending) {
+        return;
+      }
+      buf.swap(_pending);
+      _has_pending = false;
+    }
+
+    int fd = ::open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0;
+    size_t written = 0;
+    while (ok && written < buf.size()) {
+      ssize_t n = ::write(fd, buf.data() + written, buf.size() - written);
+      ok = n > 0;
+      written += ok ? n : 0;
+    }
+    // the data has to be on disk before the
+    // rename makes it the checkpoint
+    ok = ok && ::fsync(fd) == 0;
+    if (fd >= 0) {
+      ok = ::close(fd) == 0 && ok;
+    }
+    ok = ok && std::rename(tmp_file.c_str(), _file.c_str()) == 0;
+
+    if (!ok) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _error = "cannot write checkpoint " + _file + ".";
+    }
+  }
+}
+
+}
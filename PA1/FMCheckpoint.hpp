@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace FMPartition {
+
+template <typename Index>
+class BasicFMPartition;
+
+// what a long run needs to pick up where it stopped,
+// the netlist itself is read again on --resume
+struct Checkpoint {
+  enum class Mode : std::uint32_t { PASSES = 0, MEMETIC = 1 };
+  Mode mode = Mode::PASSES;
+  // netlist_fingerprint() of the netlist the run
+  // partitions (after preprocessing)
+  std::uint64_t fingerprint = 0;
+  std::int64_t cell_count = 0;
+
+  // FM passes done so far, over all sessions
+  int passes = 0;
+  // seconds spent so far, over all sessions
+  double elapsed = 0;
+  // sessions before this one, a resumed memetic run
+  // seeds its threads past the ones already used
+  int resumes = 0;
+
+  std::int64_t cut = 0;
+  std::vector<int> partition;
+
+  // memetic runs only
+  int starts = 0, offspring = 0, improvements = 0;
+  std::int64_t best_start_cut = 0;
+  std::vector<std::int64_t> population_cuts;
+  std::vector<std::vector<int>> population;
+};
+
+// hash over the cell count and the pins of every net,
+// a checkpoint only resumes on the netlist it was made for
+// (the same whatever index types the engine has)
+template <typename Index>
+std::uint64_t netlist_fingerprint(const BasicFMPartition<Index>& fm);
+
+// compact binary form: a header, then every partition
+// packed 8 cells to a byte
+std::vector<char> serialize_checkpoint(const Checkpoint& checkpoint);
+
+// throws std::runtime_error if checkpoint_file can't
+// be read or isn't a checkpoint
+Checkpoint read_checkpoint(const std::string& checkpoint_file);
+
+// writes checkpoints on a background thread: offer() hands
+// over the bytes and returns right away, the thread writes
+// them to checkpoint_file.tmp, syncs and renames it over
+// checkpoint_file, so a run killed at any point leaves
+// either the previous checkpoint or the new one; an offer
+// made while a write is going on replaces any older
+// pending one, only the newest state matters
+class CheckpointWriter {
+public:
+  // interval: seconds between two checkpoints, see due();
+  // due() and offer() are for one thread at a time
+  CheckpointWriter(const std::string& checkpoint_file, double interval);
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  // the interval has passed since the last offer,
+  // callers only build a Checkpoint when it has
+  bool due() const;
+
+  void offer(const Checkpoint& checkpoint);
+
+  // writes the last offer, if it's still pending,
+  // and stops the thread; no offers after this
+  void close();
+
+  // write errors (a full disk...) end up here instead
+  // of stopping the run, empty while all went well
+  std::string error() const;
+
+private:
+  void _run();
+
+  std::string _file;
+  std::chrono::steady_clock::duration _interval;
+  std::chrono::steady_clock::time_point _last_offer;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::vector<char> _pending;
+  bool _has_pending = false;
+  bool _stop = false;
+  std::string _error;
+  std::thread _thread;
+};
+
+}
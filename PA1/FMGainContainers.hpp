@@ -0,0 +1,250 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <functional>
+#include "FMPartition.hpp"
+
+// gain containers for BasicFMPartition::fm_pass_with<GainContainer>(),
+// fm_pass keeps one per partition side and only ever asks for
+// the best cell of a side, so every container provides:
+//
+//   void reset(CellId cell_count, Key pmax);  // empty, gains in [-pmax, pmax]
+//   void insert(CellId cell, Key gain);       // last among cells of equal gain
+//   void erase(CellId cell, Key gain);
+//   void update(CellId cell, Key old_gain, Key new_gain);
+//   bool empty() const;
+//   CellId top() const;                       // best cell, first inserted on ties
+//   Key top_gain() const;
+//
+// all of them are plain classes, the engine is instantiated
+// per container so there's no virtual call in the pass;
+// they all take a Key type for the gain, so they can
+// also hold the packed lookahead keys (see
+// BasicFMPartition::lookahead_keys), the bucket array only
+// while the packed range stays small; CellId is the engine's
+
+namespace FMPartition {
+
+// the classic FM bucket array, one list per gain value,
+// good as long as 2 * pmax + 1 stays small
+template <typename Key = int, typename CellId = int>
+class GainBucketArray {
+public:
+  void reset(CellId cell_count, Key pmax) {
+    _pmax = pmax;
+    _max_index = 2 * pmax + 1;
+    _size = 0;
+    _buckets.assign(2 * pmax + 1, GainBucketList());
+    _nodes.assign(cell_count, GainBucketNode(0));
+  }
+
+  void insert(CellId cell, Key gain) {
+    GainBucketNode* n = &_nodes[cell];
+    n->cell_id = cell;
+    _buckets[_pmax - gain].move_to_back(&n);
+    _max_index = std::min<Key>(_max_index, _pmax - gain);
+    _size++;
+  }
+
+  void erase(CellId cell, Key gain) {
+    _buckets[_pmax - gain].remove(&_nodes[cell]);
+    _size--;
+    _settle();
+  }
+
+  void update(CellId cell, Key old_gain, Key new_gain) {
+    GainBucketNode* n = &_nodes[cell];
+    _buckets[_pmax - old_gain].remove(n);
+    _buckets[_pmax - new_gain].move_to_back(&n);
+    _max_index = std::min<Key>(_max_index, _pmax - new_gain);
+    _settle();
+  }
+
+  bool empty() const {
+    return _size == 0;
+  }
+
+  CellId top() const {
+    return _buckets[_max_index].head->cell_id;
+  }
+
+  Key top_gain() const {
+    return _pmax - _max_index;
+  }
+
+private:
+  // walk the max pointer down to
+  // the first non-empty bucket
+  void _settle() {
+    if (_size == 0) {
+      _max_index = 2 * _pmax + 1;
+      return;
+    }
+    while (_buckets[_max_index].head == nullptr) {
+      _max_index++;
+    }
+  }
+
+  Key _pmax = 0;
+  // bucket index (pmax - gain) of the best gain
+  Key _max_index = 0;
+  CellId _size = 0;
+  std::vector<GainBucketList> _buckets;
+  std::vector<GainBucketNode> _nodes;
+};
+
+// same lists, but only the gains that actually occur get one,
+// for wide and sparse gain ranges (heavily weighted nets)
+template <typename Key = int, typename CellId = int>
+class GainBucketMap {
+public:
+  void reset(CellId cell_count, Key /* pmax */) {
+    _buckets.clear();
+    _nodes.assign(cell_count, GainBucketNode(0));
+  }
+
+  void insert(CellId cell, Key gain) {
+    GainBucketNode* n = &_nodes[cell];
+    n->cell_id = cell;
+    _buckets[gain].move_to_back(&n);
+  }
+
+  void erase(CellId cell, Key gain) {
+    auto it = _buckets.find(gain);
+    it->second.remove(&_nodes[cell]);
+    if (it->second.head == nullptr) {
+      _buckets.erase(it);
+    }
+  }
+
+  void update(CellId cell, Key old_gain, Key new_gain) {
+    erase(cell, old_gain);
+    insert(cell, new_gain);
+  }
+
+  bool empty() const {
+    return _buckets.empty();
+  }
+
+  CellId top() const {
+    return _buckets.begin()->second.head->cell_id;
+  }
+
+  Key top_gain() const {
+    return _buckets.begin()->first;
+  }
+
+private:
+  // highest gain first
+  std::map<Key, GainBucketList, std::greater<Key>> _buckets;
+  std::vector<GainBucketNode> _nodes;
+};
+
+// addressable binary max-heap on (gain, insertion order),
+// O(log n) per update independent of the gain range
+template <typename Key = int, typename CellId = int>
+class GainHeap {
+public:
+  void reset(CellId cell_count, Key /* pmax */) {
+    _heap.clear();
+    _pos.assign(cell_count, -1);
+    _next_seq = 0;
+  }
+
+  void insert(CellId cell, Key gain) {
+    _heap.push_back({gain, _next_seq++, cell});
+    _pos[cell] = _heap.size() - 1;
+    _sift_up(_heap.size() - 1);
+  }
+
+  void erase(CellId cell, Key /* gain */) {
+    CellId i = _pos[cell];
+    _pos[cell] = -1;
+    if (i == static_cast<CellId>(_heap.size()) - 1) {
+      _heap.pop_back();
+      return;
+    }
+    _heap[i] = _heap.back();
+    _heap.pop_back();
+    _pos[_heap[i].cell] = i;
+    if (i > 0 && _before(_heap[i], _heap[(i - 1) / 2])) {
+      _sift_up(i);
+    }
+    else {
+      _sift_down(i);
+    }
+  }
+
+  void update(CellId cell, Key old_gain, Key new_gain) {
+    erase(cell, old_gain);
+    insert(cell, new_gain);
+  }
+
+  bool empty() const {
+    return _heap.empty();
+  }
+
+  CellId top() const {
+    return _heap[0].cell;
+  }
+
+  Key top_gain() const {
+    return _heap[0].gain;
+  }
+
+private:
+  struct Entry {
+    Key gain;
+    unsigned seq;
+    CellId cell;
+  };
+
+  static bool _before(const Entry& a, const Entry& b) {
+    return a.gain > b.gain || (a.gain == b.gain && a.seq < b.seq);
+  }
+
+  void _place(CellId i, const Entry& e) {
+    _heap[i] = e;
+    _pos[e.cell] = i;
+  }
+
+  void _sift_up(CellId i) {
+    Entry e = _heap[i];
+    while (i > 0) {
+      CellId parent = (i - 1) / 2;
+      if (!_before(e, _heap[parent])) {
+        break;
+      }
+      _place(i, _heap[parent]);
+      i = parent;
+    }
+    _place(i, e);
+  }
+
+  void _sift_down(CellId i) {
+    CellId n = _heap.size();
+    Entry e = _heap[i];
+    while (true) {
+      CellId child = 2 * i + 1;
+      if (child >= n) {
+        break;
+      }
+      if (child + 1 < n && _before(_heap[child + 1], _heap[child])) {
+        child++;
+      }
+      if (!_before(_heap[child], e)) {
+        break;
+      }
+      _place(i, _heap[child]);
+      i = child;
+    }
+    _place(i, e);
+  }
+
+  std::vector<Entry> _heap;
+  // where each cell sits in _heap, -1 if not there
+  std::vector<CellId> _pos;
+  unsigned _next_seq = 0;
+};
+
+}
@@ -0,0 +1,412 @@
+#include <thread>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "FMMemetic.hpp"
+#include "FMPartition.hpp"
+#include "FMCheckpoint.hpp"
+
+namespace FMPartition {
+
+namespace {
+
+struct Individual {
+  std::vector<int> partition;
+  long long cut = 0;
+  // of the partition with cell 0 on side 0,
+  // so a mirrored copy counts as a duplicate
+  size_t hash = 0;
+};
+
+size_t partition_hash(const std::vector<int>& partition) {
+  int flip = partition.empty() ? 0 : partition[0];
+  size_t h = 14695981039346656037ULL;
+  for (int side : partition) {
+    h = (h ^ static_cast<size_t>(side ^ flip)) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// random balanced start: cells in random order,
+// side 0 until it holds half the weight
+template <typename Engine>
+std::vector<int> random_partition(const Engine& fm, std::mt19937& rng) {
+  using CellId = typename Engine::CellId;
+  std::vector<CellId> order(fm.cell_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng);
+
+  auto weight = [&](CellId c) {
+    return static_cast<size_t>(c) < fm.cell_weight.size() ? fm.cell_weight[c] : 1;
+  };
+
+  long long total = 0;
+  for (CellId c = 0; c < fm.cell_count; c++) {
+    total += weight(c);
+  }
+
+  std::vector<int> partition(fm.cell_count);
+  long long part0 = 0;
+  for (CellId c : order) {
+    partition[c] = part0 + weight(c) > total / 2;
+    if (!partition[c]) {
+      part0 += weight(c);
+    }
+  }
+  return partition;
+}
+
+template <typename CellId>
+CellId find(std::vector<CellId>& parent, CellId c) {
+  while (parent[c] != c) {
+    parent[c] = parent[parent[c]];
+    c = parent[c];
+  }
+  return c;
+}
+
+// contracts what a and b agree on into the cells of coarse,
+// runs FM there from a's sides and refines the projection
+// on fine; returns the offspring's cut
+template <typename Engine>
+long long recombine(Engine& fine, Engine& coarse, 
+  const Individual& a, const Individual& b, 
+  std::vector<int>& child, double seconds_left) {
+
+  using CellId = typename Engine::CellId;
+  using NetId = typename Engine::NetId;
+  CellId n = fine.cell_count;
+  std::vector<CellId> parent(n), weight(n, 1);
+  std::iota(parent.begin(), parent.end(), 0);
+  for (size_t c = 0; c < fine.cell_weight.size(); c++) {
+    weight[c] = fine.cell_weight[c];
+  }
+
+  // a cluster that can't cross sides is useless, 
+  // so no cluster outweighs half the balance slack
+  // (nor what a cell weight holds)
+  CellId cap = std::max<CellId>(1, static_cast<CellId>(fine.max_balance - fine.min_balance) / 2);
+  cap = std::min<CellId>(cap, std::numeric_limits<int>::max());
+
+  for (NetId net = 0; net < fine.net_count; net++) {
+    auto cs = fine.net_to_cells(net);
+    // (--no-preprocess keeps empty nets)
+    if (cs.size() == 0) {
+      continue;
+    }
+    CellId first = cs[0];
+    bool agreed = true;
+    for (CellId c : cs) {
+      if (a.partition[c] != a.partition[first] || b.partition[c] != b.partition[first]) {
+        agreed = false;
+        break;
+      }
+    }
+    if (!agreed) {
+      continue;
+    }
+
+    for (CellId c : cs) {
+      CellId r1 = find(parent, first);
+      CellId r2 = find(parent, c);
+      if (r1 != r2 && weight[r1] + weight[r2] <= cap) {
+        parent[r2] = r1;
+        weight[r1] += weight[r2];
+      }
+    }
+  }
+
+  // number the clusters
+  std::vector<CellId> cluster(n, -1), cluster_of_root(n, -1);
+  std::vector<int> cluster_weight, coarse_start;
+  for (CellId c = 0; c < n; c++) {
+    CellId r = find(parent, c);
+    if (cluster_of_root[r] < 0) {
+      cluster_of_root[r] = cluster_weight.size();
+      cluster_weight.push_back(weight[r]);
+      coarse_start.push_back(a.partition[c]);
+    }
+    cluster[c] = cluster_of_root[r];
+  }
+
+  // nets on clusters, preprocess_netlist drops the ones
+  // inside a cluster and merges the parallel ones
+  std::vector<typename Engine::PinIndex> offsets(1, 0);
+  std::vector<CellId> pins;
+  pins.reserve(fine.net_pins.size());
+  for (NetId net = 0; net < fine.net_count; net++) {
+    for (CellId c : fine.net_to_cells(net)) {
+      pins.push_back(cluster[c]);
+    }
+    offsets.push_back(pins.size());
+  }
+
+  coarse.reset();
+  coarse.load_hypergraph(cluster_weight.size(), offsets, pins, 
+    fine.balance_factor, fine.net_weight);
+  coarse.preprocess_netlist();
+  coarse.cell_weight = cluster_weight;
+  coarse.set_time_limit(seconds_left);
+  coarse.fm_refine(coarse_start);
+
+  auto coarse_partition = coarse.get_partition();
+  child.resize(n);
+  for (CellId c = 0; c < n; c++) {
+    child[c] = coarse_partition[cluster[c]];
+  }
+
+  fine.set_time_limit(seconds_left);
+  long long cut = fine.fm_refine(child);
+  child = fine.get_partition();
+  return cut;
+}
+
+}
+
+template <typename Index>
+MemeticResult memetic_partition(BasicFMPartition<Index>& fm, const MemeticOptions& options) {
+  PhaseTimer timer(fm.stats, "memetic");
+
+  int threads = options.threads;
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  int population_size = options.population > 0 ? 
+    options.population : std::max(12, 2 * threads);
+
+  auto deadline = std::chrono::steady_clock::now() + 
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(options.time_limit));
+  auto seconds_left = [&]() {
+    std::chrono::duration<double> left = deadline - std::chrono::steady_clock::now();
+    // set_time_limit(0) would mean no limit at all
+    return std::max(left.count(), 1e-3);
+  };
+
+  std::vector<Individual> population;
+  MemeticResult result;
+  std::mutex mutex;
+  // random starts begun so far, and the slowest one
+  // in seconds (both under mutex)
+  int starts = 0;
+  double start_seconds = 0;
+
+  auto start_time = std::chrono::steady_clock::now();
+  Checkpoint checkpoint;
+  checkpoint.mode = Checkpoint::Mode::MEMETIC;
+  checkpoint.cell_count = fm.cell_count;
+  if (options.checkpoint || options.resume) {
+    checkpoint.fingerprint = netlist_fingerprint(fm);
+  }
+
+  if (options.resume) {
+    const Checkpoint& r = *options.resume;
+    if (r.mode != Checkpoint::Mode::MEMETIC || r.fingerprint != checkpoint.fingerprint) {
+      throw std::runtime_error("the checkpoint is not a memetic run on this netlist.");
+    }
+    for (size_t i = 0; i < r.population.size(); i++) {
+      Individual x;
+      x.partition = r.population[i];
+      x.cut = r.population_cuts[i];
+      x.hash = partition_hash(x.partition);
+      population.push_back(std::move(x));
+    }
+    result.starts = r.starts;
+    result.offspring = r.offspring;
+    result.improvements = r.improvements;
+    result.best_start_cut = r.best_start_cut;
+    starts = population.size();
+    checkpoint.passes = r.passes;
+    checkpoint.elapsed = r.elapsed;
+    checkpoint.resumes = r.resumes + 1;
+  }
+
+  // call with mutex held
+  auto offer_checkpoint = [&]() {
+    if (population.empty()) {
+      return;
+    }
+    checkpoint.starts = result.starts;
+    checkpoint.offspring = result.offspring;
+    checkpoint.improvements = result.improvements;
+    checkpoint.best_start_cut = result.best_start_cut;
+    checkpoint.population.clear();
+    checkpoint.population_cuts.clear();
+    size_t best = 0;
+    for (size_t i = 0; i < population.size(); i++) {
+      checkpoint.population.push_back(population[i].partition);
+      checkpoint.population_cuts.push_back(population[i].cut);
+      if (population[i].cut < population[best].cut) {
+        best = i;
+      }
+    }
+    checkpoint.partition = population[best].partition;
+    checkpoint.cut = population[best].cut;
+    std::chrono::duration<double> session = std::chrono::steady_clock::now() - start_time;
+    double elapsed = checkpoint.elapsed;
+    checkpoint.elapsed += session.count();
+    options.checkpoint->offer(checkpoint);
+    checkpoint.elapsed = elapsed;
+  };
+
+  // duplicates are dropped, a new individual fills up the
+  // population or else takes the place of the worst one
+  auto insert = [&](Individual&& child, bool is_start) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (is_start) {
+      result.starts++;
+      if (result.starts == 1 || child.cut < result.best_start_cut) {
+        result.best_start_cut = child.cut;
+      }
+    }
+    else {
+      result.offspring++;
+    }
+
+    size_t best = 0, worst = 0;
+    for (size_t i = 0; i < population.size(); i++) {
+      if (population[i].hash == child.hash) {
+        return;
+      }
+      if (population[i].cut < population[best].cut) {
+        best = i;
+      }
+      if (population[i].cut > population[worst].cut) {
+        worst = i;
+      }
+    }
+    if (!is_start && !population.empty() && child.cut < population[best].cut) {
+      result.improvements++;
+    }
+
+    if (static_cast<int>(population.size()) < population_size) {
+      population.push_back(std::move(child));
+    }
+    else if (child.cut < population[worst].cut) {
+      population[worst] = std::move(child);
+    }
+
+    if (options.checkpoint && options.checkpoint->due()) {
+      offer_checkpoint();
+    }
+  };
+
+  auto worker = [&](int t) {
+    // each thread partitions its own copy, the coarse
+    // netlists are smaller so the same index types do
+    BasicFMPartition<Index> fine = fm;
+    fine.parse_threads = 1;
+    fine.parallel_write = false;
+    fine.on_pass = nullptr;
+    BasicFMPartition<Index> coarse;
+    coarse.large_net_threshold = fm.large_net_threshold;
+    coarse.gain_policy = fm.gain_policy;
+    coarse.lookahead_levels = fm.lookahead_levels;
+    // a resumed run starts streams of its own
+    std::mt19937 rng(options.seed + t + checkpoint.resumes * 0x9e3779b9u);
+    // flipped before every pick, so the first one is a start
+    bool start_turn = false;
+
+    do {
+      // the copies' timings and pass counters would
+      // only pile up, fm.stats gets the total
+      fine.stats.clear();
+
+      Individual a, b;
+      bool start;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        // no more starts than the population holds, nor than
+        // fit in a quarter of the budget; short of two parents
+        // it has to be a start, else starts and offspring take
+        // turns, so recombination begins right away even when
+        // a single start takes a good part of the budget
+        int start_cap = population_size;
+        if (start_seconds > 0) {
+          start_cap = std::min(start_cap, 
+            std::max(2, static_cast<int>(options.time_limit / 4 / start_seconds)));
+        }
+        start_turn = !start_turn;
+        start = population.size() < 2 || (start_turn && starts < start_cap);
+        if (start) {
+          starts++;
+        }
+      }
+      if (!start) {
+        // two binary tournaments, never the same winner twice
+        std::lock_guard<std::mutex> lock(mutex);
+        // (skip == population.size() skips nothing)
+        auto pick = [&](size_t skip) {
+          size_t n = population.size() - (skip < population.size());
+          std::uniform_int_distribution<size_t> any(0, n - 1);
+          size_t x = any(rng), y = any(rng);
+          x += x >= skip;
+          y += y >= skip;
+          return population[x].cut <= population[y].cut ? x : y;
+        };
+        if (population.size() < 2) {
+          start = true;
+        }
+        else {
+          size_t first = pick(population.size());
+          a = population[first];
+          b = population[pick(first)];
+        }
+      }
+
+      Individual child;
+      if (start || a.hash == b.hash) {
+        // a fresh start, also when both parents
+        // are the same and there's nothing to combine
+        auto start_begin = std::chrono::steady_clock::now();
+        fine.set_time_limit(seconds_left());
+        child.cut = fine.fm_refine(random_partition(fine, rng));
+        child.partition = fine.get_partition();
+        start = true;
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start_begin;
+        std::lock_guard<std::mutex> lock(mutex);
+        start_seconds = std::max(start_seconds, took.count());
+      }
+      else {
+        if (b.cut < a.cut) {
+          std::swap(a, b);
+        }
+        child.cut = recombine(fine, coarse, a, b, child.partition, seconds_left());
+      }
+      child.hash = partition_hash(child.partition);
+      insert(std::move(child), start);
+    } while (std::chrono::steady_clock::now() < deadline);
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++) {
+    pool.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& t : pool) {
+    t.join();
+  }
+
+  if (options.checkpoint) {
+    offer_checkpoint();
+  }
+
+  auto best = std::min_element(population.begin(), population.end(), 
+    [](const Individual& x, const Individual& y) { return x.cut < y.cut; });
+
+  fm.init();
+  fm.set_partition(best->partition);
+  result.cut = fm.calc_cut();
+  fm.stats.cut = result.cut;
+  return result;
+}
+
+template MemeticResult memetic_partition(BasicFMPartition<NarrowIndex>&, const MemeticOptions&);
+template MemeticResult memetic_partition(BasicFMPartition<WidePinIndex>&, const MemeticOptions&);
+template MemeticResult memetic_partition(BasicFMPartition<WideIndex>&, const MemeticOptions&);
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+
+namespace FMPartition {
+
+template <typename Index>
+class BasicFMPartition;
+struct Checkpoint;
+class CheckpointWriter;
+
+struct MemeticOptions {
+  // 0 means one per hardware thread
+  int threads = 0;
+  // wall-clock budget in seconds, shared by all threads
+  double time_limit = 10;
+  // 0 means 2 per thread, at least 12; also the most
+  // random starts, fewer when they would take more
+  // than a quarter of time_limit
+  int population = 0;
+  unsigned seed = 1;
+  // offered the population every time it's due
+  // and once more at the end
+  CheckpointWriter* checkpoint = nullptr;
+  // a checkpoint of an earlier, interrupted run to go
+  // on from: its population, counters and time spent
+  // (time_limit stays the budget of this run alone)
+  const Checkpoint* resume = nullptr;
+};
+
+struct MemeticResult {
+  long long cut = 0;
+  // best of the random starts, to see what recombination bought
+  long long best_start_cut = 0;
+  int starts = 0;
+  int offspring = 0;
+  // offspring that beat the best partition so far
+  int improvements = 0;
+};
+
+// evolutionary FM on the netlist already in fm (loaded and
+// preprocessed): a population of random starts refined by FM,
+// and offspring of two parents until the time is up (starts and
+// offspring take turns as soon as there are two parents); an
+// offspring contracts every group of cells that both parents
+// put on the same side (joined by nets neither parent cuts)
+// into one weighted cell, runs FM on that much smaller netlist
+// starting from the better parent, and refines the projection
+// on the full netlist, so it's never worse than that parent
+//
+// the best partition ends up in fm, ready for write_result
+// (FMMemetic.cpp has it for every engine FMPartition.cpp has)
+template <typename Index>
+MemeticResult memetic_partition(BasicFMPartition<Index>& fm, const MemeticOptions& options);
+
+}
@@ -1,28 +1,43 @@
 #include <fstream>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <algorithm>
 #include <cassert>
+#include <limits>
+#include <thread>
+#include <charconv>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include "FMPartition.hpp"
+#include "FMGainContainers.hpp"
+#include "FMStreamReader.hpp"
 
 
 namespace FMPartition {
 
-Net::Net() :
+template <typename Index>
+BasicFMPartition<Index>::Net::Net() :
   id(0)
 {
 
 }
 
 
-Net::Net(int id) :
+template <typename Index>
+BasicFMPartition<Index>::Net::Net(NetId id) :
   id(id)
 {
   
 }
 
 // updates cut/uncut
-void Net::update_is_cut(FMPartition& fm) {
+template <typename Index>
+void BasicFMPartition<Index>::Net::update_is_cut(BasicFMPartition& fm) {
   // TODO:
   // maintain a cell count for both sides
   // for each net
@@ -31,9 +46,9 @@ void Net::update_is_cut(FMPartition& fm) {
 
   // if any one of the cells belongs to another partition
   // this net is considered cut
-  auto& cell_ids = fm.net_to_cells[id];
+  auto cell_ids = fm.net_to_cells(id);
   
-  for (int i = 1; i < cell_ids.size(); i++) {
+  for (size_t i = 1; i < cell_ids.size(); i++) {
     if (fm.cells[cell_ids[i]].partition_id ^ fm.cells[cell_ids[0]].partition_id) {
       is_cut = true;
       return;
@@ -43,33 +58,37 @@ void Net::update_is_cut(FMPartition& fm) {
 }
 
 
-Cell::Cell() :
+template <typename Index>
+BasicFMPartition<Index>::Cell::Cell() :
   id(0)
 {
 
 }
 
-Cell::Cell(int id) :
+template <typename Index>
+BasicFMPartition<Index>::Cell::Cell(CellId id) :
   id(id),
   locked(0)
 {
 
 }
 
-int Cell::fs(FMPartition& fm) {
+template <typename Index>
+int BasicFMPartition<Index>::Cell::fs(BasicFMPartition& fm) {
   int fs = 0;
-  auto& ns = fm.cell_to_nets[id];
+  auto ns = fm.cell_to_nets(id);
   // visit each associated net to this cell
-  for (int net : ns) {
+  for (NetId net : ns) {
     // is this net cut?
-    if (!fm.nets[net].is_cut) {
+    // (large nets don't contribute to gains)
+    if (!fm.nets[net].is_cut || fm.nets[net].is_large) {
       continue;
     }
     // is this net connected to another cell in
     // the same partition as this cell?
-    auto& cs = fm.net_to_cells[fm.nets[net].id];
+    auto cs = fm.net_to_cells(fm.nets[net].id);
     bool net_connected_to_multcells = false;
-    for (int cell : cs) {
+    for (CellId cell : cs) {
       if (cell != id && fm.cells[cell].partition_id == partition_id) {
         net_connected_to_multcells = true;
         break;
@@ -83,26 +102,27 @@ int Cell::fs(FMPartition& fm) {
       // we found a cut net
       // that only connects to this cell 
       // [in the same partition]
-      fs++;
+      fs += fm.nets[net].weight;
     }
   }
   return fs;
 }
 
-int Cell::te(FMPartition& fm) {
+template <typename Index>
+int BasicFMPartition<Index>::Cell::te(BasicFMPartition& fm) {
   // simply uncut nets connected to this cell
   int te = 0;
   
-  auto& ns = fm.cell_to_nets[id];
+  auto ns = fm.cell_to_nets(id);
   for (auto& net : ns) {
-    if (!fm.nets[net].is_cut) {
-      te++;
+    if (!fm.nets[net].is_cut && !fm.nets[net].is_large) {
+      te += fm.nets[net].weight;
     }
   }
   return te;
 }
 
-GainBucketNode::GainBucketNode(int cell_id) :
+GainBucketNode::GainBucketNode(long long cell_id) :
   cell_id(cell_id),
   next(nullptr),
   prev(nullptr)
@@ -121,12 +141,12 @@ GainBucketList::~GainBucketList() {
 
 }
 
-void GainBucketList::insert_back(int cell_id) {
+GainBucketNode* GainBucketList::insert_back(long long cell_id) {
   GainBucketNode* n = new GainBucketNode(cell_id);
   
   if (tail == nullptr) {
     tail = head = n;
-    return;
+    return n;
   }
   
   
@@ -135,30 +155,15 @@ void GainBucketList::insert_back(int cell_id) {
     n->prev = tail;
     tail = n;
   }
-
+  return n;
 }
 
-GainBucketNode* GainBucketList::remove(int cell_id) { 
+GainBucketNode* GainBucketList::remove(long long cell_id) { 
   GainBucketNode* curr = head;
 
   while (curr != nullptr) {
     if (curr->cell_id == cell_id) {
-      if (curr == head) {
-        head = curr->next;
-      }
-      else if (curr == tail) {
-        tail = curr->prev;
-        curr->prev->next = nullptr;
-      }
-      else {
-        curr->prev->next = curr->next;
-        curr->next->prev = curr->prev;
-      }
-
-
-      curr->prev = nullptr;
-      curr->next = nullptr;
-
+      remove(curr);
       return curr;
     }
     curr = curr->next;
@@ -168,6 +173,25 @@ GainBucketNode* GainBucketList::remove(int cell_id) {
   return nullptr;
 }
 
+void GainBucketList::remove(GainBucketNode* n) {
+  if (n->prev != nullptr) {
+    n->prev->next = n->next;
+  }
+  else {
+    head = n->next;
+  }
+
+  if (n->next != nullptr) {
+    n->next->prev = n->prev;
+  }
+  else {
+    tail = n->prev;
+  }
+
+  n->prev = nullptr;
+  n->next = nullptr;
+}
+
 void GainBucketList::move_to_back(GainBucketNode** n) {
   if (tail == nullptr || head == nullptr) {
     tail = head = *n;
@@ -203,53 +227,651 @@ void GainBucketList::dump(std::ostream& os) const {
 
 
 
-FMPartition::FMPartition() {
+template <typename Index>
+BasicFMPartition<Index>::BasicFMPartition() {
 
 }
 
-void FMPartition::read_netlist_file(const std::string& inputFileName) {
-  std::ifstream ifs;
-  ifs.open(inputFileName);
-  
-  if (!ifs) {
-    throw std::runtime_error("failed to open this file.");
+template <typename Index>
+void BasicFMPartition<Index>::reset() {
+  // clear() keeps the vectors' capacity
+  // and the maps' bucket arrays around
+  acc_gain.clear();
+  move_order.clear();
+  nets.clear();
+  cells.clear();
+  net_offsets.clear();
+  net_ends.clear();
+  net_pins.clear();
+  cell_offsets.clear();
+  cell_ends.clear();
+  cell_nets.clear();
+  eco_touched_cells.clear();
+  eco_removed_cells.clear();
+  free_cells.clear();
+  stats.clear();
+
+  net_weight.clear();
+  cell_weight.clear();
+  preprocess_report = PreprocessReport();
+  dropped_duplicate_pins = 0;
+
+  curr_max_gain = 0;
+  pmax = 0;
+  pin_count = 0;
+  cut_size = 0;
+  cell_count = net_count = 0;
+  part0_cell_count = part1_cell_count = 0;
+  excluded_net_count = excluded_pin_count = 0;
+  timed_out = false;
+}
+
+namespace {
+
+bool is_space(char ch) {
+  return ch == ' ' || ch == '\n' || ch == '\t' || 
+         ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+// a piece of the mapped netlist file that
+// one thread parses on its own
+struct ParseChunk {
+  const char* begin;
+  const char* end;
+  // what the counting pass found
+  size_t nets = 0;
+  size_t pins = 0;
+  long long max_cell = 0;
+  bool bad_cell = false;
+  // where the chunk's nets / pins go in the CSR arrays
+  size_t net_base = 0;
+  size_t pin_base = 0;
+};
+
+// the first net start at or after p, only a "NET" token
+// right after a ";" token counts, so a chunk never
+// starts in the middle of a net
+const char* next_net_start(const char* p, const char* begin, const char* end) {
+  for (; p < end; p++) {
+    if (*p != ';' || (p > begin && !is_space(p[-1])) || 
+        (p + 1 < end && !is_space(p[1]))) {
+      continue;
+    }
+    const char* q = p + 1;
+    while (q < end && is_space(*q)) {
+      q++;
+    }
+    if (end - q >= 3 && q[0] == 'N' && q[1] == 'E' && q[2] == 'T' && 
+        (end - q == 3 || is_space(q[3]))) {
+      return q;
+    }
+  }
+  return end;
+}
+
+// goes over the tokens of a chunk the same way the old
+// ifstream loop did: "NET", a name, cells "c<id>" up to ";",
+// Fill = false only counts, Fill = true writes the CSR arrays
+// (once the counts are known to fit their types)
+template <bool Fill, typename PinIndex, typename CellId>
+void parse_chunk(ParseChunk& chunk, PinIndex* offsets, CellId* pins) {
+  const char* p = chunk.begin;
+  const char* end = chunk.end;
+  bool in_net = false;
+  size_t net = 0;
+  size_t pin = 0;
+
+  auto close_net = [&]() {
+    in_net = false;
+    net++;
+    if constexpr (Fill) {
+      offsets[chunk.net_base + net] = chunk.pin_base + pin;
+    }
+  };
+
+  while (true) {
+    while (p < end && is_space(*p)) {
+      p++;
+    }
+    if (p == end) {
+      break;
+    }
+    const char* token = p;
+    while (p < end && !is_space(*p)) {
+      p++;
+    }
+
+    if (!in_net) {
+      in_net = (p - token == 3 && token[0] == 'N' && token[1] == 'E' && token[2] == 'T');
+    }
+    else if (p - token == 1 && *token == ';') {
+      close_net();
+    }
+    else if (*token == 'c') {
+      long long cell = 0;
+      auto [ptr, ec] = std::from_chars(token + 1, p, cell);
+      if (ec != std::errc() || cell < 1) {
+        chunk.bad_cell = true;
+        cell = 1;
+      }
+      if constexpr (Fill) {
+        pins[chunk.pin_base + pin] = cell - 1;
+      }
+      else {
+        chunk.max_cell = std::max(chunk.max_cell, cell);
+      }
+      pin++;
+    }
   }
 
-  // start reading in the netlists
-  std::string buffer;
+  // a last net without ";"
+  if (in_net) {
+    close_net();
+  }
+
+  if constexpr (!Fill) {
+    chunk.nets = net;
+    chunk.pins = pin;
+  }
+}
+
+// sequential parse of a decompressed stream, same tokens
+// as parse_chunk, but a token may be split between two
+// pieces of the stream so those go through a small string;
+// the counts are checked against Engine's index types as
+// they grow, there's no counting pass to do it up front
+template <typename Engine>
+void parse_stream(DecompressingReader& reader, std::string& first_line,
+  std::vector<typename Engine::PinIndex>& offsets, 
+  std::vector<typename Engine::CellId>& pins, long long& max_cell) {
+
+  bool in_first_line = true;
+  bool in_net = false;
+  std::string pending;
+
+  auto on_token = [&](const char* token, const char* end) {
+    if (!in_net) {
+      in_net = (end - token == 3 && token[0] == 'N' && token[1] == 'E' && token[2] == 'T');
+    }
+    else if (end - token == 1 && *token == ';') {
+      in_net = false;
+      Engine::check_index_range(max_cell, offsets.size(), pins.size());
+      offsets.push_back(pins.size());
+    }
+    else if (*token == 'c') {
+      long long cell = 0;
+      auto [ptr, ec] = std::from_chars(token + 1, end, cell);
+      if (ec != std::errc() || cell < 1) {
+        throw std::runtime_error("bad cell name in the netlist.");
+      }
+      max_cell = std::max(max_cell, cell);
+      Engine::check_index_range(max_cell, offsets.size(), pins.size() + 1);
+      pins.push_back(cell - 1);
+    }
+  };
+
+  auto flush_pending = [&]() {
+    if (!pending.empty()) {
+      on_token(pending.data(), pending.data() + pending.size());
+      pending.clear();
+    }
+  };
+
+  const char* data;
+  size_t size;
+  while (reader.next(data, size)) {
+    const char* p = data;
+    const char* end = data + size;
+
+    if (in_first_line) {
+      const char* line_end = std::find(p, end, '\n');
+      first_line.append(p, line_end);
+      if (line_end == end) {
+        continue;
+      }
+      in_first_line = false;
+      p = line_end;
+    }
+
+    while (p < end) {
+      if (is_space(*p)) {
+        flush_pending();
+        p++;
+        continue;
+      }
+      const char* token = p;
+      while (p < end && !is_space(*p)) {
+        p++;
+      }
+      if (p == end) {
+        // may go on in the next piece
+        pending.append(token, p);
+      }
+      else if (!pending.empty()) {
+        pending.append(token, p);
+        flush_pending();
+      }
+      else {
+        on_token(token, p);
+      }
+    }
+  }
+  flush_pending();
+
+  // a last net without ";"
+  if (in_net) {
+    Engine::check_index_range(max_cell, offsets.size(), pins.size());
+    offsets.push_back(pins.size());
+  }
+}
+
+// n12 -> 11, c7 -> 6 (prefix is 'n' or 'c'),
+// -1 for anything that isn't such a name
+long long parse_index(const std::string& name, char prefix) {
+  const char* end = name.data() + name.size();
+  long long id = 0;
+  if (name.size() < 2 || name[0] != prefix) {
+    return -1;
+  }
+  auto [p, ec] = std::from_chars(name.data() + 1, end, id);
+  if (ec != std::errc() || p != end || id < 1) {
+    return -1;
+  }
+  return id - 1;
+}
+
+// writes row as row r of a CSR array: over the old row
+// if it fits there, else at the back of items (the old
+// place is just left unused)
+template <typename PinIndex, typename Id>
+void put_row(std::vector<PinIndex>& offsets, std::vector<PinIndex>& ends,
+  std::vector<Id>& items, size_t r, const std::vector<Id>& row) {
+
+  if (row.size() > ends[r] - offsets[r]) {
+    offsets[r] = items.size();
+    items.insert(items.end(), row.begin(), row.end());
+  }
+  else {
+    std::copy(row.begin(), row.end(), items.begin() + offsets[r]);
+  }
+  ends[r] = offsets[r] + row.size();
+}
+
+// read-only mapping of a whole file
+struct MappedFile {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  explicit MappedFile(const std::string& name) {
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open this file.");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      size = st.st_size;
+      void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("failed to map this file.");
+      }
+      ::madvise(p, size, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(p);
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (data) {
+      ::munmap(const_cast<char*>(data), size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::read_netlist_file(const std::string& inputFileName) {
+  PhaseTimer timer(stats, "parse");
+
+  // compressed input: decompressing on one thread
+  // and tokenizing on this one, no temporary file
+  if (is_compressed_netlist(inputFileName)) {
+    DecompressingReader reader(inputFileName);
+    std::string first_line;
+    long long max_cell = 0;
+    net_offsets.assign(1, 0);
+    net_pins.clear();
+    parse_stream<BasicFMPartition>(reader, first_line, net_offsets, net_pins, max_cell);
+
+    balance_factor = std::stod(first_line);
+    net_count = net_offsets.size() - 1;
+    cell_count = std::max<long long>(cell_count, max_cell);
+    build_cell_to_nets();
+    return;
+  }
+
+  MappedFile file(inputFileName);
+  const char* begin = file.data;
+  const char* end = file.data + file.size;
   
   // read in the first line: balance factor
-  std::getline(ifs, buffer);
-  balance_factor = std::stod(buffer);
+  const char* line_end = std::find(begin, end, '\n');
+  balance_factor = std::stod(std::string(begin, line_end));
+  begin = line_end;
+
+  // split the rest at net starts, one chunk per thread,
+  // but no point in chunks below ~1MB
+  size_t threads = parse_threads > 0 ? 
+    parse_threads : std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, static_cast<size_t>(end - begin) / (1 << 20) + 1);
+
+  std::vector<ParseChunk> chunks;
+  const char* chunk_begin = begin;
+  for (size_t t = 1; t <= threads && chunk_begin < end; t++) {
+    const char* chunk_end = t == threads ? end : 
+      next_net_start(std::max(chunk_begin, begin + (end - begin) * t / threads), begin, end);
+    chunks.push_back({chunk_begin, chunk_end});
+    chunk_begin = chunk_end;
+  }
 
-  while (1) {
-    ifs >> buffer;
-    if (ifs.eof()) {
-      break;
+  auto run_all = [&](auto&& fn) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < chunks.size(); t++) {
+      workers.emplace_back(fn, t);
     }
+    if (!chunks.empty()) {
+      fn(0);
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+  };
+
+  // count, prefix sum to global net ids and pin offsets, fill;
+  // chunks are in file order so the net ids are the same 
+  // as parsing the whole file front to back
+  run_all([&](size_t t) { parse_chunk<false, PinIndex, CellId>(chunks[t], nullptr, nullptr); });
+
+  size_t total_nets = 0;
+  size_t total_pins = 0;
+  long long max_cell = cell_count;
+  for (auto& chunk : chunks) {
+    if (chunk.bad_cell) {
+      throw std::runtime_error("bad cell name in the netlist.");
+    }
+    chunk.net_base = total_nets;
+    chunk.pin_base = total_pins;
+    total_nets += chunk.nets;
+    total_pins += chunk.pins;
+    max_cell = std::max(max_cell, chunk.max_cell);
+  }
+  // before the arrays are set up, a netlist too big for
+  // this engine costs only the counting pass
+  check_index_range(max_cell, total_nets, total_pins);
+
+  cell_count = max_cell;
+  net_count = total_nets;
+  net_offsets.assign(net_count + 1, 0);
+  net_pins.resize(total_pins);
+  run_all([&](size_t t) { 
+    parse_chunk<true>(chunks[t], net_offsets.data(), net_pins.data()); 
+  });
+
+  build_cell_to_nets();
+}
 
-    if (buffer == "NET") {
-      while (buffer != ";") {
-        // first string is net id, e.g. n1, n13 etc.
-        ifs >> buffer;
-        if (buffer[0] == 'c') {
-          int cell = stoul(buffer.substr(1));
-          if (cell > cell_count) {
-            cell_count = cell;
-          }
-          cell_to_nets[cell-1].push_back(net_count);
-          net_to_cells[net_count].push_back(cell-1);
-        }
+template <typename Index>
+void BasicFMPartition<Index>::build_cell_to_nets() {
+  // drop repeated pins (compacting net_pins in place)
+  // while counting, last_net[c] is the last net c was on
+  std::vector<NetId> last_net(cell_count, -1);
+  cell_offsets.assign(cell_count + 1, 0);
+  dropped_duplicate_pins = 0;
+  PinIndex kept = 0;
+  for (NetId n = 0; n < net_count; n++) {
+    PinIndex begin = net_offsets[n], end = net_offsets[n + 1];
+    net_offsets[n] = kept;
+    for (PinIndex i = begin; i < end; i++) {
+      CellId c = net_pins[i];
+      if (last_net[c] == n) {
+        dropped_duplicate_pins++;
+        continue;
       }
-      net_count++;
+      last_net[c] = n;
+      net_pins[kept++] = c;
+      cell_offsets[c + 1]++;
+    }
+  }
+  net_offsets[net_count] = kept;
+  net_pins.resize(kept);
+  net_ends.assign(net_offsets.begin() + 1, net_offsets.end());
+
+  // prefix sum, fill: the nets of
+  // each cell come out in net order
+  for (CellId c = 0; c < cell_count; c++) {
+    cell_offsets[c + 1] += cell_offsets[c];
+  }
+
+  cell_nets.resize(net_pins.size());
+  cell_ends.assign(cell_offsets.begin(), cell_offsets.end() - 1);
+  for (NetId n = 0; n < net_count; n++) {
+    for (CellId c : net_to_cells(n)) {
+      cell_nets[cell_ends[c]++] = n;
+    }
+  }
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::check_index_range(unsigned long long cells, 
+  unsigned long long nets, unsigned long long pins) {
+
+  // counts stay below the id types' max, so
+  // count + 1 (the CSR offset rows) can't wrap
+  if (cells < static_cast<unsigned long long>(std::numeric_limits<CellId>::max()) &&
+      nets < static_cast<unsigned long long>(std::numeric_limits<NetId>::max()) &&
+      pins <= std::numeric_limits<PinIndex>::max()) {
+    return;
+  }
+  throw IndexOverflow(std::to_string(cells) + " cells, " + 
+    std::to_string(nets) + " nets and " + std::to_string(pins) + " pins are more than " + 
+    std::to_string(8 * sizeof(CellId)) + "-bit cell ids, " + 
+    std::to_string(8 * sizeof(NetId)) + "-bit net ids and " + 
+    std::to_string(8 * sizeof(PinIndex)) + "-bit pin offsets hold.");
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::load_hypergraph(CellId num_cells, 
+  const std::vector<PinIndex>& offsets,
+  const std::vector<CellId>& pins,
+  double balance,
+  const std::vector<int>& weights) {
+
+  PhaseTimer timer(stats, "load");
+
+  if (offsets.empty() || offsets.back() != pins.size()) {
+    throw std::runtime_error("net offsets don't match the pin array.");
+  }
+  if (!weights.empty() && weights.size() + 1 != offsets.size()) {
+    throw std::runtime_error("need one weight per net.");
+  }
+  check_index_range(std::max<CellId>(num_cells, 0), offsets.size() - 1, pins.size());
+  for (CellId c : pins) {
+    if (c < 0 || c >= num_cells) {
+      throw std::runtime_error("pin refers to a cell out of range.");
+    }
+  }
+
+  balance_factor = balance;
+  cell_count = num_cells;
+  net_count = offsets.size() - 1;
+  net_offsets = offsets;
+  net_pins = pins;
+  net_weight = weights;
+
+  build_cell_to_nets();
+}
+
+template <typename Index>
+std::vector<int> BasicFMPartition<Index>::get_partition() const {
+  std::vector<int> partition(cells.size());
+  for (size_t i = 0; i < cells.size(); i++) {
+    partition[i] = cells[i].partition_id;
+  }
+  return partition;
+}
 
+namespace {
+
+// partition_hypergraph on any of the array types: the arrays
+// are copied into the engine anyway, so they are converted
+// to whichever engine the sizes fit on the way
+template <typename Offset, typename Pin>
+PartitionResult partition_arrays(long long num_cells,
+  const std::vector<Offset>& net_offsets,
+  const std::vector<Pin>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights) {
+
+  // checked on the caller's types, a conversion
+  // must not make a bad pin look right
+  if (net_offsets.empty() || net_offsets.back() != net_pins.size()) {
+    throw std::runtime_error("net offsets don't match the pin array.");
+  }
+  for (Pin c : net_pins) {
+    if (c < 0 || c >= num_cells) {
+      throw std::runtime_error("pin refers to a cell out of range.");
     }
   }
 
+  auto load = [&](auto& fm) {
+    using Engine = std::decay_t<decltype(fm)>;
+    using PinIndex = typename Engine::PinIndex;
+    using CellId = typename Engine::CellId;
+    Engine::check_index_range(std::max(num_cells, 0LL), 
+      net_offsets.size() - 1, net_pins.size());
+    fm.load_hypergraph(num_cells, 
+      std::vector<PinIndex>(net_offsets.begin(), net_offsets.end()),
+      std::vector<CellId>(net_pins.begin(), net_pins.end()), 
+      balance_factor, net_weights);
+  };
+
+  return with_fitting_engine(load, [](auto& fm) {
+    fm.preprocess_netlist();
+    PartitionResult result;
+    result.cut = fm.fm_full_pass();
+    result.partition = fm.get_partition();
+    return result;
+  });
+}
+
+}
+
+PartitionResult partition_hypergraph(std::int32_t num_cells,
+  const std::vector<std::uint32_t>& net_offsets,
+  const std::vector<std::int32_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights) {
+  return partition_arrays(num_cells, net_offsets, net_pins, balance_factor, net_weights);
+}
+
+PartitionResult partition_hypergraph(std::int32_t num_cells,
+  const std::vector<std::uint64_t>& net_offsets,
+  const std::vector<std::int32_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights) {
+  return partition_arrays(num_cells, net_offsets, net_pins, balance_factor, net_weights);
+}
+
+PartitionResult partition_hypergraph(std::int64_t num_cells,
+  const std::vector<std::uint64_t>& net_offsets,
+  const std::vector<std::int64_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights) {
+  return partition_arrays(num_cells, net_offsets, net_pins, balance_factor, net_weights);
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::preprocess_netlist() {
+  PhaseTimer timer(stats, "preprocess");
+
+  PreprocessReport& report = preprocess_report;
+  report = PreprocessReport();
+  report.nets_before = net_count;
+  // the loader already dropped these
+  report.duplicate_pins = dropped_duplicate_pins;
+  report.pins_before = dropped_duplicate_pins;
+  
+  std::vector<PinIndex> new_offsets(1, 0);
+  std::vector<CellId> new_pins;
+  std::vector<int> new_weight;
+  new_pins.reserve(net_pins.size());
+  
+  // hash of the (sorted) pin list -> nets with that hash
+  std::unordered_map<size_t, std::vector<NetId>> same_hash;
+  
+  for (NetId i = 0; i < net_count; i++) {
+    auto cs = net_to_cells(i);
+    report.pins_before += cs.size();
+    int w = static_cast<size_t>(i) < net_weight.size() ? net_weight[i] : 1;
+
+    // dedupe pins
+    std::sort(cs.begin(), cs.end());
+    CellId* last = std::unique(cs.begin(), cs.end());
+    report.duplicate_pins += cs.end() - last;
+    cs = IdRange<CellId>{cs.begin(), last};
+
+    // a single pin net is never cut
+    if (cs.size() <= 1) {
+      report.single_pin_nets++;
+      continue;
+    }
+
+    size_t h = cs.size();
+    for (CellId c : cs) {
+      h ^= std::hash<CellId>()(c) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+
+    // same pins as a net we already kept?
+    bool merged = false;
+    for (NetId kept : same_hash[h]) {
+      size_t kept_size = new_offsets[kept + 1] - new_offsets[kept];
+      if (kept_size == cs.size() &&
+          std::equal(cs.begin(), cs.end(), new_pins.begin() + new_offsets[kept])) {
+        new_weight[kept] += w;
+        report.merged_nets++;
+        merged = true;
+        break;
+      }
+    }
+    if (merged) {
+      continue;
+    }
+
+    NetId id = new_weight.size();
+    same_hash[h].push_back(id);
+    new_pins.insert(new_pins.end(), cs.begin(), cs.end());
+    new_offsets.push_back(new_pins.size());
+    new_weight.push_back(w);
+  }
 
+  // rebuild cell -> nets with the new numbering
+  net_offsets = std::move(new_offsets);
+  net_pins = std::move(new_pins);
+  net_weight = std::move(new_weight);
+  net_count = net_weight.size();
+  build_cell_to_nets();
+  
+  report.pins_after = net_pins.size();
+  report.nets_after = net_count;
 }
 
-void FMPartition::init() {
+template <typename Index>
+void BasicFMPartition<Index>::init(bool order_nets) {
+  PhaseTimer timer(stats, "init");
   std::srand(std::time(nullptr));
   
   if (cell_count == 0) {
@@ -258,337 +880,1398 @@ void FMPartition::init() {
   else {
       
     cells.resize(cell_count);
-    for (int i = 0; i < cell_count; i++) {
+    long long total_weight = 0;
+    for (CellId i = 0; i < cell_count; i++) {
       cells[i] = Cell(i);
+      if (static_cast<size_t>(i) < cell_weight.size()) {
+        cells[i].weight = cell_weight[i];
+      }
+      total_weight += cells[i].weight;
     }
 
     nets.resize(net_count);
-    for (int i = 0; i < net_count; i++) {
+    excluded_net_count = excluded_pin_count = 0;
+    pin_count = 0;
+    for (NetId i = 0; i < net_count; i++) {
       nets[i] = Net(i);
+      if (static_cast<size_t>(i) < net_weight.size()) {
+        nets[i].weight = net_weight[i];
+      }
+      
+      size_t degree = net_to_cells(i).size();
+      pin_count += degree;
+      if (large_net_threshold > 0 && degree > static_cast<size_t>(large_net_threshold)) {
+        nets[i].is_large = true;
+        excluded_net_count++;
+        excluded_pin_count += degree;
+      }
     }
 
+    if (order_nets) {
+      for (CellId c = 0; c < cell_count; c++) {
+        order_cell_nets(c);
+      }
+    }
+    free_cells.clear();
+
+    // a cell's gain can't get past the
+    // total weight of the nets it's on
+    pmax = 0;
+    for (CellId c = 0; c < cell_count; c++) {
+      int weighted_degree = 0;
+      for (NetId n : cell_to_nets(c)) {
+        if (!nets[n].is_large) {
+          weighted_degree += nets[n].weight;
+        }
+      }
+      pmax = std::max(pmax, weighted_degree);
+    }
+
+    stats.cells = cell_count;
+    stats.nets = net_count;
+    stats.pins = pin_count;
+
     // calculate balance criterion
-    min_balance = cell_count * (1.0f - balance_factor) / 2.0f;
-    max_balance = cell_count * (1.0f + balance_factor) / 2.0f;
+    // (on weights, which is the cell count unless coarsened)
+    min_balance = total_weight * (1.0f - balance_factor) / 2.0f;
+    max_balance = total_weight * (1.0f + balance_factor) / 2.0f;
   }
 }
 
-void FMPartition::init_partition() {
+template <typename Index>
+void BasicFMPartition<Index>::order_cell_nets(CellId cell) {
+  // by degree, so the gain update dispatch in
+  // fm_pass sees runs of the same kernel instead
+  // of jumping around (and large nets all end up
+  // at the back)
+  auto ns = cell_to_nets(cell);
+  std::stable_sort(ns.begin(), ns.end(), 
+    [&](NetId a, NetId b) {
+      return net_to_cells(a).size() < net_to_cells(b).size();
+    });
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::init_partition() {
   // to satisfy the balance constraint
   // I simply assign the first half to one partition
   // and the other half to the other
-  for (int i = 0; i < (cell_count / 2); i++) {
-    cells[i].partition_id = 0;
+  // (by weight, so it's the first cell_count / 2 cells
+  // as long as every cell weighs 1)
+  long long total_weight = 0;
+  for (auto& c : cells) {
+    total_weight += c.weight;
   }
 
-  for (int i = (cell_count / 2); i < cell_count; i++) {
-    cells[i].partition_id = 1;
+  part0_cell_count = part1_cell_count = 0;
+  for (auto& c : cells) {
+    c.partition_id = part0_cell_count + c.weight > total_weight / 2;
+    if (!c.partition_id) {
+      part0_cell_count += c.weight;
+    }
+    else {
+      part1_cell_count += c.weight;
+    }
   }
 
-  part0_cell_count = cell_count / 2;
-  part1_cell_count = cell_count - part0_cell_count;
-
    // update cut/uncut
-  for (int i = 0; i < net_count; i++) {
-    nets[i].update_is_cut(*this);
+  for (auto& n : nets) {
+    n.update_is_cut(*this);
   }
-
+  cut_size = calc_cut();
 }
 
-int FMPartition::calc_cut() {
-  int cut = 0;
+template <typename Index>
+long long BasicFMPartition<Index>::calc_cut() {
+  long long cut = 0;
   for (auto& n : nets) {
     if (n.is_cut) {
-      cut++;
+      cut += n.weight;
     }    
   }
 
   return cut;
 }
 
-int FMPartition::fm_pass() {
-  int locked_cell_cnt = 0;
-  int max_gain_seq = 0;
-  int max_accu_gain = 0;
-  int curr_accu_gain = 0;
-  // copy cells to a tmp container
-  std::vector<Cell> tmp_cells = cells;
+template <typename Index>
+template <typename GainContainer>
+void BasicFMPartition<Index>::adjust_gain(GainContainer* gains, CellId cell_id, int delta) {
+  FM_STAT(stats.passes.back().gain_updates++);
+  FM_STAT(stats.passes.back().bucket_ops += 2);
+
+  int old_gain = cells[cell_id].gain;
+  cells[cell_id].gain += delta;
+  gains[cells[cell_id].partition_id].update(cell_id, old_gain, cells[cell_id].gain);
+}
+
+template <typename Index>
+template <int Degree, typename GainContainer>
+void BasicFMPartition<Index>::update_net_gains(GainContainer* gains, CellId cell_id, NetId net, bool from_part) {
+  auto cs = net_to_cells(net);
+  int w = nets[net].weight;
   
-  while (locked_cell_cnt < cell_count) {
-    // navigate the the max gain bucket
-    int max_gain_bucket_index = 0;
-
-    bool base_cell_found = false;
-    GainBucketNode* node;
-    while (!base_cell_found) {
-      if (!gain_bucket[max_gain_bucket_index].head) {
-        max_gain_bucket_index++;
+  if constexpr (Degree == 2) {
+    // 2-pin net: the other pin either goes from
+    // uncut to cut (+2w if it follows) or from
+    // cut to uncut (-2w if it leaves)
+    CellId other = (cs[0] == cell_id) ? cs[1] : cs[0];
+    
+    if (cells[other].locked) {
+      return;
+    }
+
+    adjust_gain(gains, other, cells[other].partition_id == from_part ? 2 * w : -2 * w);
+  }
+  else if constexpr (Degree == 3) {
+    // 3-pin net: working through the T(n)/F(n) cases,
+    // every free pin on from_part gains w
+    // and every free pin on to_part loses w
+    for (auto& c : cs) {
+      if (c == cell_id || cells[c].locked) {
         continue;
       }
-      // found a max gain bucket
-      // see if there's a cell that fits the balance
-      // criterion
-      node = gain_bucket[max_gain_bucket_index].head;
-      do {
-        if (is_move_balanced(node->cell_id)) {
-          // remove this node from the bucket
-          gain_bucket[max_gain_bucket_index].remove(node->cell_id);
-          base_cell_found = true;
-          break;
-        }
-          
-        node = node->next;
-      } while (node != nullptr);
-      
-      max_gain_bucket_index++;
+      adjust_gain(gains, c, cells[c].partition_id == from_part ? w : -w);
     }
-    
-    // record the move order 
-    // and gain
-    move_order.push_back(node->cell_id);
-    if (cells[node->cell_id].gain < 0) {
-      curr_accu_gain -= std::abs(cells[node->cell_id].gain);
-    } else {
-      if (curr_accu_gain + cells[node->cell_id].gain > max_accu_gain) {
-        max_accu_gain = curr_accu_gain + cells[node->cell_id].gain;
-        max_gain_seq = locked_cell_cnt;
+  }
+  else {
+    // generic kernel: count T(n) and F(n)
+    // over the whole net
+    bool to_part = !from_part;
+  
+    // in to_partition, how many cells
+    // are connected to net n?
+    CellId T_n = 0;
+    for (auto& c : cs) {
+      if (cells[c].partition_id == to_part) {
+        T_n++;
       }
-      curr_accu_gain += cells[node->cell_id].gain;
     }
 
-    // lock this cell
-    cells[node->cell_id].locked = true;
-    locked_cell_cnt++;
-    
-    // calculate F(net) and T(net)
-    // before-move and after-move
-    // to identify critical nets
-    bool from_part = cells[node->cell_id].partition_id;
-    bool to_part = !from_part;
-    
-    auto& ns = cell_to_nets[node->cell_id];
-    for (auto& n : ns) {
-      // in to_partition, how many cells
-      // are connected to net n?
-      
-      auto& cs = net_to_cells[n];
-      int T_n = 0;
+    // if T(net) == 0
+    // increment gains of all free cells
+    // connected to net n
+    //
+    // if T(net) == 1
+    // only decrement that one cell's gain
+    // and only if it's free
+    if (T_n == 0) {
       for (auto& c : cs) {
-        if (cells[c].partition_id == to_part) {
-          T_n++;
-          if (T_n > 1) {
-            break;
-          }
+        if (!cells[c].locked) {
+          adjust_gain(gains, c, w);
         }
       }
-
-      if (T_n > 1) {
-        continue;
-      }
-
-      // if T(net) == 0
-      // increment gains of all free cells
-      // connected to net n
-      //
-      // if T(net) == 1
-      // only decrement that one cell's gain
-      // and only if it's free
-      
-      if (T_n == 0) {
-        for (auto& c : cs) {
-          if (!cells[c].locked) {
-            // move to its corresponding bucket
-            GainBucketNode* n = gain_bucket[pmax - cells[c].gain].remove(c);
-            cells[c].gain++;
-            gain_bucket[pmax - cells[c].gain].move_to_back(&n);
-          }
-        }
-      } else if (T_n == 1) {
-        for (auto& c : cs) {
-          if (cells[c].partition_id == to_part && !cells[c].locked) {
-            // move to its corresponding bucket
-            GainBucketNode* n = gain_bucket[pmax - cells[c].gain].remove(c);
-            cells[c].gain--;
-            gain_bucket[pmax - cells[c].gain].move_to_back(&n);
-            break;
-          }
+    } else if (T_n == 1) {
+      for (auto& c : cs) {
+        if (cells[c].partition_id == to_part && !cells[c].locked) {
+          adjust_gain(gains, c, -w);
+          break;
         }
       }
+    }
 
-      // derive F(net) from T(net)
-      // F(net) = cell_connected_to_net - T(net)
-      int F_n = cs.size() - T_n;
-      
-      // change net distribution to reflect the move
-      F_n--;
-      T_n++;
-      
-      
-      if (F_n > 1) {
-        continue;
-      }
-
-      // if F(net) == 0
-      // decrement gains of all free cells
-      // connected to net n
-      //
-      // if F(net) == 1
-      // only increment that one cell's gain
-      // and only if it's free
-      if (F_n == 0) {
-        for (auto& c : cs) {
-          if (!cells[c].locked) {
-            // move to its corresponding bucket
-            GainBucketNode* n = gain_bucket[pmax - cells[c].gain].remove(c);
-            cells[c].gain--;
-            gain_bucket[pmax - cells[c].gain].move_to_back(&n);
-          }
+    // derive F(net) from T(net)
+    // F(net) = cell_connected_to_net - T(net)
+    // and change net distribution to reflect the move
+    CellId F_n = cs.size() - T_n - 1;
+
+    // if F(net) == 0
+    // decrement gains of all free cells
+    // connected to net n
+    //
+    // if F(net) == 1
+    // only increment that one cell's gain
+    // and only if it's free
+    if (F_n == 0) {
+      for (auto& c : cs) {
+        if (!cells[c].locked) {
+          adjust_gain(gains, c, -w);
         }
-      } else if (F_n == 1) {
-        for (auto& c : cs) {
-          if (cells[c].partition_id == from_part && !cells[c].locked) {
-            // move to its corresponding bucket
-            GainBucketNode* n = gain_bucket[pmax - cells[c].gain].remove(c);
-            cells[c].gain++;
-            gain_bucket[pmax - cells[c].gain].move_to_back(&n);
-            break;
-          }
+      }
+    } else if (F_n == 1) {
+      for (auto& c : cs) {
+        if (cells[c].partition_id == from_part && !cells[c].locked) {
+          adjust_gain(gains, c, w);
+          break;
         }
       }
-
-    } 
-
-    cells[node->cell_id].partition_id = !cells[node->cell_id].partition_id;
-  } 
-
-  // get the best move sequence
-  // now make the actual moves
-  cells = tmp_cells;
-  part0_cell_count = cell_count / 2;
-  part1_cell_count = cell_count - part0_cell_count;
-
-  for (int i = 0; i < max_gain_seq; i++) {
-    int order = move_order[i];
-    if (!cells[order].partition_id) {
-      part0_cell_count--;
-      part1_cell_count++;
-    } else {
-      part1_cell_count--;
-      part0_cell_count++;
     }
-    cells[order].partition_id = !cells[order].partition_id;
   }
+}
 
-  // update uncut/cut for nets
-  for (auto&n : nets) {
-    n.update_is_cut(*this);
-  }
-   
-  return calc_cut();
+namespace {
+
+// does the net add anything to any gain level,
+// count = net_side_count[net]
+template <int Levels, typename Count>
+bool lookahead_relevant(const std::array<Count, 4>& count) {
+  return (count[2] == 0 && count[0] <= Levels) || 
+         (count[3] == 0 && count[1] <= Levels);
 }
 
-int FMPartition::fm_full_pass() {
-  init();
-  init_partition();
-  init_gainbucket();
- 
-  return fm_pass();
 }
 
-void FMPartition::write_result(const std::string& output_file) {
-  std::ofstream ofs;
-  ofs.open(output_file);
-  
-  int cut_size = calc_cut(); 
-  ofs << "Cutsize = " << cut_size << "\n";
+template <typename Index>
+template <int Levels>
+long long BasicFMPartition<Index>::lookahead_contribution(const std::array<CellId, 4>& count, 
+  int side, int w, int& level1) const {
 
-  std::vector<int> g0, g1;
-  for (int i = 0; i < cells.size(); i++) {
-    if (!cells[i].partition_id) {
-      g0.push_back(cells[i].id + 1);
-    } else {
-      g1.push_back(cells[i].id + 1);
-    }
-  }
+  CellId free_here = count[side], locked_here = count[2 + side];
+  CellId free_there = count[1 - side], locked_there = count[3 - side];
+  long long key = 0;
+  level1 = 0;
 
-  ofs << "G1 " << g0.size() << "\n";
-  for (int i = 0; i < g0.size(); i++) {
-    ofs << "c" << g0[i] << " ";
+  // moving the free_here cells takes the net off this side
+  if (locked_here == 0 && free_here >= 1 && free_here <= Levels) {
+    key += w * lookahead_place[free_here - 1];
+    level1 += free_here == 1 ? w : 0;
   }
-  ofs << ";\n";
-  ofs << "G2 " << g1.size() << "\n";
-
-  for (int i = 0; i < g1.size(); i++) {
-    ofs << "c" << g1[i] << " ";
+  // and leaving spoils a net free_there moves from leaving the other side
+  if (locked_there == 0 && free_there < Levels) {
+    key -= w * lookahead_place[free_there];
+    level1 -= free_there == 0 ? w : 0;
   }
-  ofs << ";\n";
+  return key;
 }
 
-bool FMPartition::is_move_balanced(int cell_id) {
+template <typename Index>
+template <int Levels>
+void BasicFMPartition<Index>::init_lookahead() {
+  // no level gets past pmax in either direction, so
+  // digits in base 2 * pmax + 1 keep the order
+  long long place = 1;
+  for (int i = Levels - 1; i >= 0; i--) {
+    lookahead_place[i] = place;
+    place *= 2LL * pmax + 1;
+  }
+
+  auto count_net = [&](NetId n) {
+    net_side_count[n] = {0, 0, 0, 0};
+    for (CellId c : net_to_cells(n)) {
+      net_side_count[n][(cells[c].locked ? 2 : 0) + cells[c].partition_id]++;
+    }
+  };
+
+  auto init_keys = [&](Cell& c) {
+    // level 1 adds up to fs - te
+    lookahead_keys[c.id] = 0;
+    c.gain = 0;
+    for (NetId n : cell_to_nets(c.id)) {
+      if (nets[n].is_large) {
+        continue;
+      }
+      int level1;
+      lookahead_keys[c.id] += lookahead_contribution<Levels>(net_side_count[n], 
+        c.partition_id, nets[n].weight, level1);
+      c.gain += level1;
+    }
+  };
+
+  net_side_count.resize(net_count);
+  lookahead_keys.resize(cell_count);
+  if (free_cells.empty()) {
+    for (NetId n = 0; n < net_count; n++) {
+      if (!nets[n].is_large) {
+        count_net(n);
+      }
+    }
+    for (auto& c : cells) {
+      if (!c.locked) {
+        init_keys(c);
+      }
+    }
+    return;
+  }
+
+  // only the free cells' nets are ever looked at
+  new_net_marks();
+  for (CellId c : free_cells) {
+    for (NetId n : cell_to_nets(c)) {
+      if (!nets[n].is_large && mark_net(n)) {
+        count_net(n);
+      }
+    }
+  }
+  for (CellId c : free_cells) {
+    init_keys(cells[c]);
+  }
+}
+
+template <typename Index>
+template <int Levels, typename GainContainer>
+void BasicFMPartition<Index>::update_net_lookahead(GainContainer* gains, CellId cell_id, NetId net, bool from_part) {
+  auto& count = net_side_count[net];
+  std::array<CellId, 4> before = count;
+  // cell_id leaves from_part's free cells
+  // and becomes a locked cell on the other side
+  count[from_part]--;
+  count[2 + !from_part]++;
+
+  if (!lookahead_relevant<Levels>(before) && !lookahead_relevant<Levels>(count)) {
+    return;
+  }
+
+  // a net gives every free cell on one side the same
+  // contribution, so the change is worked out per side
+  int w = nets[net].weight;
+  long long key_delta[2];
+  int gain_delta[2];
+  for (int side = 0; side < 2; side++) {
+    int before1, after1;
+    key_delta[side] = lookahead_contribution<Levels>(count, side, w, after1) - 
+                      lookahead_contribution<Levels>(before, side, w, before1);
+    gain_delta[side] = after1 - before1;
+  }
+  if (key_delta[0] == 0 && key_delta[1] == 0) {
+    return;
+  }
+
+  for (CellId c : net_to_cells(net)) {
+    int side = cells[c].partition_id;
+    if (c == cell_id || cells[c].locked || key_delta[side] == 0) {
+      continue;
+    }
+    FM_STAT(stats.passes.back().gain_updates++);
+    FM_STAT(stats.passes.back().bucket_ops += 2);
+
+    long long old_key = lookahead_keys[c];
+    lookahead_keys[c] += key_delta[side];
+    cells[c].gain += gain_delta[side];
+    gains[side].update(c, old_key, lookahead_keys[c]);
+  }
+}
+
+template <typename Index>
+template <int Levels>
+long long BasicFMPartition<Index>::fm_lookahead_pass() {
+  long long radix = 2LL * pmax + 1;
+  long long range = 1;
+  for (int i = 0; i < Levels; i++) {
+    range *= radix;
+  }
+
+  switch (gain_policy) {
+    case GainPolicy::MAP:
+      return fm_pass_with<GainBucketMap<long long, CellId>, Levels>();
+    case GainPolicy::HEAP:
+      return fm_pass_with<GainHeap<long long, CellId>, Levels>();
+    default:
+      if (range <= 8LL * cell_count + 1024) {
+        return fm_pass_with<GainBucketArray<long long, CellId>, Levels>();
+      }
+      return fm_pass_with<GainHeap<long long, CellId>, Levels>();
+  }
+}
+
+template <typename Index>
+long long BasicFMPartition<Index>::fm_pass() {
+  // lookahead keys span (2 * pmax + 1)^levels values,
+  // dense buckets while that's small, a heap past that
+  if (lookahead_levels > 1 && pmax < (1 << 20)) {
+    return lookahead_levels == 2 ? fm_lookahead_pass<2>() : fm_lookahead_pass<3>();
+  }
+
+  // dense buckets as long as the gain range is about
+  // the size of the netlist, sparse buckets past that
+  switch (gain_policy) {
+    case GainPolicy::DENSE:
+      return fm_pass_with<GainBucketArray<int, CellId>>();
+    case GainPolicy::MAP:
+      return fm_pass_with<GainBucketMap<int, CellId>>();
+    case GainPolicy::HEAP:
+      return fm_pass_with<GainHeap<int, CellId>>();
+    default:
+      if (2LL * pmax + 1 <= 8LL * cell_count + 1024) {
+        return fm_pass_with<GainBucketArray<int, CellId>>();
+      }
+      return fm_pass_with<GainBucketMap<int, CellId>>();
+  }
+}
+
+template <typename Index>
+template <typename GainContainer, int Levels>
+long long BasicFMPartition<Index>::fm_pass_with() {
+  PhaseTimer timer(stats, "pass");
+  stats.passes.emplace_back();
+
+  CellId locked_cell_cnt = 0;
+  CellId max_gain_seq = 0;
+  long long max_accu_gain = 0;
+  long long curr_accu_gain = 0;
+  // the moves are the pass' undo log, nothing
+  // else is saved (see the rollback below)
+  move_order.clear();
+  long long start_cut = cut_size;
+
+  // 0 = run the whole pass, < 0 = pick from the size
+  bool truncated = false;
+  CellId stop_moves = early_stop_moves;
+  if (stop_moves < 0) {
+    stop_moves = std::max<CellId>(1000, cell_count / 20);
+  }
+  
+  // the key a cell is filed under
+  auto key = [&](CellId cell_id) {
+    if constexpr (Levels > 1) {
+      return lookahead_keys[cell_id];
+    }
+    else {
+      return cells[cell_id].gain;
+    }
+  };
+
+  if constexpr (Levels > 1) {
+    init_lookahead<Levels>();
+  }
+
+  // keys stay within [-key_bound, key_bound]
+  long long key_bound = pmax;
+  for (int i = 1; i < Levels; i++) {
+    key_bound = key_bound * (2LL * pmax + 1) + pmax;
+  }
+
+  // one container per side, holding the free cells
+  struct GainContainers {
+    GainContainer side[2];
+    CellId cell_count = -1;
+    long long key_bound = -1;
+    // emptied by the pass that used them last
+    bool empty = false;
+  };
+  // one address per instantiation
+  static const char containers_type = 0;
+  if (gain_containers.type != &containers_type) {
+    gain_containers.containers = std::make_shared<GainContainers>();
+    gain_containers.type = &containers_type;
+  }
+  auto& containers = *static_cast<GainContainers*>(gain_containers.containers.get());
+  GainContainer* gains = containers.side;
+  if (!containers.empty || containers.cell_count != cell_count || 
+      containers.key_bound != key_bound) {
+    gains[0].reset(cell_count, key_bound);
+    gains[1].reset(cell_count, key_bound);
+    containers.cell_count = cell_count;
+    containers.key_bound = key_bound;
+  }
+  containers.empty = false;
+
+  if (free_cells.empty()) {
+    for (auto& c : cells) {
+      if (!c.locked) {
+        gains[c.partition_id].insert(c.id, key(c.id));
+      }
+    }
+  }
+  else {
+    for (CellId c : free_cells) {
+      gains[cells[c].partition_id].insert(c, key(c));
+    }
+  }
+
+  while (locked_cell_cnt < cell_count) {
+    // out of time: stop here, the rollback below
+    // still leaves us at the best prefix so far
+    if (locked_cell_cnt % deadline_check_interval == 0 && deadline_passed()) {
+      break;
+    }
+
+    // early stop: the rollback below only keeps the best
+    // prefix, so once a better one is unlikely (no new best
+    // for stop_moves moves, or the running gain fell
+    // early_stop_margin below the best) the rest is wasted
+    CellId since_best = move_order.size() - max_gain_seq;
+    if ((stop_moves > 0 && since_best >= stop_moves) ||
+        (early_stop_margin > 0 && curr_accu_gain < max_accu_gain - early_stop_margin)) {
+      truncated = true;
+      break;
+    }
+
+    // the best cell of each side is the only candidate
+    // there, since balance only depends on the side;
+    // take the better of the sides that may move,
+    // the larger side on ties
+    int from_side = -1;
+    for (int side = 0; side < 2; side++) {
+      if (gains[side].empty() || 
+          !move_keeps_balance(side, cells[gains[side].top()].weight)) {
+        continue;
+      }
+      if (from_side < 0 || 
+          gains[side].top_gain() > gains[from_side].top_gain() ||
+          (gains[side].top_gain() == gains[from_side].top_gain() &&
+           part1_cell_count > part0_cell_count)) {
+        from_side = side;
+      }
+    }
+
+    // no free cell left that can move
+    // without breaking the balance
+    if (from_side < 0) {
+      break;
+    }
+
+    CellId base_cell = gains[from_side].top();
+    gains[from_side].erase(base_cell, key(base_cell));
+    FM_STAT(stats.passes.back().bucket_ops++);
+    is_move_balanced(base_cell);
+    
+    // record the move order 
+    // and gain, the best prefix includes this move
+    move_order.push_back(base_cell);
+    curr_accu_gain += cells[base_cell].gain;
+    if (curr_accu_gain > max_accu_gain) {
+      max_accu_gain = curr_accu_gain;
+      max_gain_seq = move_order.size();
+    }
+
+    // lock this cell
+    cells[base_cell].locked = true;
+    locked_cell_cnt++;
+    
+    // calculate F(net) and T(net)
+    // before-move and after-move
+    // to identify critical nets
+    bool from_part = cells[base_cell].partition_id;
+    
+    auto ns = cell_to_nets(base_cell);
+    for (auto& n : ns) {
+      // nets are sorted by degree in init()
+      // so this dispatch is mostly predictable,
+      // and once we hit a large net the rest are large too
+      if (nets[n].is_large) {
+        break;
+      }
+      FM_STAT(stats.passes.back().nets_scanned++);
+
+      if constexpr (Levels > 1) {
+        update_net_lookahead<Levels>(gains, base_cell, n, from_part);
+      }
+      else {
+        switch (net_to_cells(n).size()) {
+          case 2:
+            update_net_gains<2>(gains, base_cell, n, from_part);
+            break;
+          case 3:
+            update_net_gains<3>(gains, base_cell, n, from_part);
+            break;
+          default:
+            update_net_gains<0>(gains, base_cell, n, from_part);
+            break;
+        }
+      }
+    } 
+
+    cells[base_cell].partition_id = !cells[base_cell].partition_id;
+  } 
+
+  // the cells that never moved are still filed,
+  // take them out so the next pass can start
+  // with the same containers
+  if (!free_cells.empty()) {
+    for (CellId c : free_cells) {
+      if (!cells[c].locked) {
+        gains[cells[c].partition_id].erase(c, key(c));
+      }
+    }
+    containers.empty = true;
+  }
+
+  // takes back the moves [from, to), newest first
+  auto undo_moves = [&](CellId from, CellId to) {
+    for (CellId i = to - 1; i >= from; i--) {
+      CellId order = move_order[i];
+      int w = cells[order].weight;
+      if (cells[order].partition_id) {
+        part1_cell_count -= w;
+        part0_cell_count += w;
+      } else {
+        part0_cell_count -= w;
+        part1_cell_count += w;
+      }
+      cells[order].partition_id = !cells[order].partition_id;
+    }
+  };
+
+  // update uncut/cut for the nets
+  // of the first `count` moved cells
+  auto update_cut = [&](CellId count) {
+    new_net_marks();
+    for (CellId i = 0; i < count; i++) {
+      for (NetId n : cell_to_nets(move_order[i])) {
+        if (!mark_net(n)) {
+          continue;
+        }
+        bool was_cut = nets[n].is_cut;
+        nets[n].update_is_cut(*this);
+        cut_size += (nets[n].is_cut - was_cut) * nets[n].weight;
+      }
+    }
+  };
+
+  // keep the best move sequence: take back the
+  // moves after it and unlock every cell the pass moved
+  undo_moves(max_gain_seq, move_order.size());
+  for (CellId order : move_order) {
+    cells[order].locked = false;
+  }
+  update_cut(max_gain_seq);
+
+  // the gains leave large nets out, so the best
+  // prefix can still cut more than we started with;
+  // then take it back too, a pass never leaves
+  // a worse partition behind
+  if (cut_size > start_cut) {
+    undo_moves(0, max_gain_seq);
+    update_cut(max_gain_seq);
+    max_gain_seq = 0;
+  }
+  
+  long long cut = cut_size;
+  
+  PassStats& ps = stats.passes.back();
+  ps.moves = move_order.size();
+  ps.best_prefix = max_gain_seq;
+  ps.truncated = truncated;
+  ps.cut = cut;
+  ps.ms = timer.elapsed_ms();
+  
+  return cut;
+}
+
+template <typename Index>
+long long BasicFMPartition<Index>::fm_full_pass() {
+  init();
+  init_partition();
+  init_gainbucket();
+ 
+  long long cut = fm_pass();
+  if (on_pass) {
+    on_pass(cut);
+  }
+
+  // with a time budget, spend what's left
+  // on more passes while they still help
+  while (time_limit > 0 && !timed_out) {
+    init_gainbucket();
+    long long new_cut = fm_pass();
+    if (new_cut >= cut) {
+      break;
+    }
+    cut = new_cut;
+    if (on_pass) {
+      on_pass(cut);
+    }
+  }
+
+  stats.cut = cut;
+  return cut;
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::set_partition(const std::vector<int>& partition) {
+  part0_cell_count = part1_cell_count = 0;
+  for (auto& c : cells) {
+    c.partition_id = partition[c.id];
+    if (!c.partition_id) {
+      part0_cell_count += c.weight;
+    }
+    else {
+      part1_cell_count += c.weight;
+    }
+  }
+
+  for (auto& n : nets) {
+    n.update_is_cut(*this);
+  }
+  cut_size = calc_cut();
+}
+
+template <typename Index>
+long long BasicFMPartition<Index>::fm_refine(const std::vector<int>& partition) {
+  init();
+  set_partition(partition);
+
+  long long cut = calc_cut();
+  while (!timed_out) {
+    init_gainbucket();
+    long long new_cut = fm_pass();
+    if (new_cut >= cut) {
+      break;
+    }
+    cut = new_cut;
+    if (on_pass) {
+      on_pass(cut);
+    }
+  }
+
+  stats.cut = cut;
+  return cut;
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::set_time_limit(double seconds) {
+  time_limit = seconds;
+  timed_out = false;
+  deadline = std::chrono::steady_clock::now() + 
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(seconds));
+}
+
+template <typename Index>
+bool BasicFMPartition<Index>::deadline_passed() {
+  if (time_limit > 0 && !timed_out) {
+    timed_out = std::chrono::steady_clock::now() >= deadline;
+  }
+  return timed_out;
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::apply_netlist_delta(const std::string& delta_file) {
+  PhaseTimer timer(stats, "delta");
+  std::ifstream ifs;
+  ifs.open(delta_file);
+  
+  if (!ifs) {
+    throw std::runtime_error("failed to open delta file.");
+  }
+  
+  // every id is checked before any row is touched: it must
+  // name an existing net / cell, or with may_add the next
+  // new one (the delta then adds it)
+  auto index_of = [&](const std::string& name, char prefix, long long count, bool may_add) {
+    long long id = parse_index(name, prefix);
+    if (id < 0) {
+      throw std::runtime_error("bad name in delta: " + name);
+    }
+    if (id > count || (id == count && !may_add)) {
+      throw std::runtime_error(std::string("delta refers to unknown ") + 
+        (prefix == 'n' ? "net " : "cell ") + name);
+    }
+    if (id == count) {
+      // the new one still needs an id of its type
+      check_index_range(prefix == 'c' ? id + 1 : cell_count, 
+        prefix == 'n' ? id + 1 : net_count, net_pins.size());
+    }
+    return id;
+  };
+  auto net_index = [&](const std::string& name, bool may_add = false) {
+    return index_of(name, 'n', net_count, may_add);
+  };
+  auto cell_index = [&](const std::string& name, bool may_add = false) {
+    return index_of(name, 'c', cell_count, may_add);
+  };
+
+  auto erase_from = [](auto& v, auto x) {
+    auto it = std::find(v.begin(), v.end(), x);
+    if (it != v.end()) {
+      v.erase(it);
+    }
+  };
+
+  // only the rows the delta edits are copied out (on
+  // first touch) and written back at the end, the rest
+  // of the CSR arrays stays where it is
+  NetId old_net_count = net_count;
+  CellId old_cell_count = cell_count;
+  std::unordered_map<NetId, std::vector<CellId>> net_rows;
+  std::unordered_map<CellId, std::vector<NetId>> cell_rows;
+
+  auto net_row = [&](NetId net) -> std::vector<CellId>& {
+    auto [it, added] = net_rows.try_emplace(net);
+    if (added && net < old_net_count) {
+      auto cs = net_to_cells(net);
+      it->second.assign(cs.begin(), cs.end());
+    }
+    return it->second;
+  };
+
+  auto cell_row = [&](CellId cell) -> std::vector<NetId>& {
+    auto [it, added] = cell_rows.try_emplace(cell);
+    if (added && cell < old_cell_count) {
+      auto ns = cell_to_nets(cell);
+      it->second.assign(ns.begin(), ns.end());
+    }
+    return it->second;
+  };
+
+  auto touch_net = [&](NetId net) {
+    for (CellId c : net_row(net)) {
+      eco_touched_cells.push_back(c);
+    }
+  };
+
+  auto add_pin = [&](NetId net, CellId cell) {
+    if (cell + 1 > cell_count) {
+      cell_count = cell + 1;
+    }
+    // a cell is on a net at most once
+    auto& row = net_row(net);
+    if (std::find(row.begin(), row.end(), cell) != row.end()) {
+      return;
+    }
+    cell_row(cell).push_back(net);
+    row.push_back(cell);
+    eco_touched_cells.push_back(cell);
+  };
+
+  std::string buffer, net_name, cell_name;
+  auto read_name = [&](std::string& name) {
+    if (!(ifs >> name)) {
+      throw std::runtime_error("delta ends in the middle of " + buffer);
+    }
+  };
+
+  // on a bad line the rows edited so far are dropped with
+  // net_rows / cell_rows, only the counts need restoring
+  size_t old_touched = eco_touched_cells.size();
+  size_t old_removed = eco_removed_cells.size();
+  try {
+    while (ifs >> buffer) {
+      if (buffer == "ADD_NET") {
+        read_name(net_name);
+        NetId net = net_index(net_name, true);
+        if (net < net_count && !net_row(net).empty()) {
+          throw std::runtime_error("delta adds existing net " + net_name);
+        }
+        net_count = std::max(net_count, net + 1);
+        
+        for (read_name(cell_name); cell_name != ";"; read_name(cell_name)) {
+          add_pin(net, cell_index(cell_name, true));
+        }
+        touch_net(net);
+      }
+      else if (buffer == "REMOVE_NET") {
+        read_name(net_name);
+        NetId net = net_index(net_name);
+        touch_net(net);
+        for (CellId c : net_row(net)) {
+          erase_from(cell_row(c), net);
+        }
+        net_row(net).clear();
+      }
+      else if (buffer == "ADD_PIN") {
+        read_name(net_name);
+        read_name(cell_name);
+        NetId net = net_index(net_name);
+        add_pin(net, cell_index(cell_name, true));
+        touch_net(net);
+      }
+      else if (buffer == "REMOVE_PIN") {
+        read_name(net_name);
+        read_name(cell_name);
+        NetId net = net_index(net_name);
+        CellId cell = cell_index(cell_name);
+        erase_from(net_row(net), cell);
+        erase_from(cell_row(cell), net);
+        touch_net(net);
+        eco_touched_cells.push_back(cell);
+      }
+      else if (buffer == "REMOVE_CELL") {
+        read_name(cell_name);
+        CellId cell = cell_index(cell_name);
+        for (NetId net : cell_row(cell)) {
+          erase_from(net_row(net), cell);
+          touch_net(net);
+        }
+        cell_row(cell).clear();
+        eco_removed_cells.push_back(cell);
+      }
+      else {
+        throw std::runtime_error("unknown delta command " + buffer);
+      }
+    }
+
+    // a row that grew moves to the back of its array
+    unsigned long long net_side = net_pins.size(), cell_side = cell_nets.size();
+    for (auto& [net, row] : net_rows) {
+      net_side += row.size();
+    }
+    for (auto& [cell, row] : cell_rows) {
+      cell_side += row.size();
+    }
+    check_index_range(cell_count, net_count, std::max(net_side, cell_side));
+  }
+  catch (...) {
+    net_count = old_net_count;
+    cell_count = old_cell_count;
+    eco_touched_cells.resize(old_touched);
+    eco_removed_cells.resize(old_removed);
+    throw;
+  }
+
+  // new nets / cells start out as empty rows
+  net_offsets.resize(net_count + 1, net_pins.size());
+  net_ends.resize(net_count, net_pins.size());
+  cell_offsets.resize(cell_count + 1, cell_nets.size());
+  cell_ends.resize(cell_count, cell_nets.size());
+
+  for (auto& [net, row] : net_rows) {
+    put_row(net_offsets, net_ends, net_pins, net, row);
+  }
+  for (auto& [cell, row] : cell_rows) {
+    put_row(cell_offsets, cell_ends, cell_nets, cell, row);
+  }
+  net_offsets[net_count] = net_pins.size();
+  cell_offsets[cell_count] = cell_nets.size();
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::read_partition_file(const std::string& partition_file) {
+  std::ifstream ifs;
+  ifs.open(partition_file);
+  
+  if (!ifs) {
+    throw std::runtime_error("failed to open partition file.");
+  }
+
+  std::vector<bool> assigned(cell_count, false);
+  std::string buffer;
+  
+  // Cutsize = X
+  ifs >> buffer >> buffer >> buffer;
+
+  // G1 n c.. ; G2 n c.. ;
+  for (int part = 0; part < 2; part++) {
+    ifs >> buffer >> buffer;
+    while (ifs >> buffer && buffer != ";") {
+      long long cell = parse_index(buffer, 'c');
+      if (cell < 0) {
+        throw std::runtime_error("bad cell name in partition file: " + buffer);
+      }
+      // removed cells may still be in an old result
+      if (cell < cell_count) {
+        cells[cell].partition_id = part;
+        assigned[cell] = true;
+      }
+    }
+  }
+
+  for (CellId c : eco_removed_cells) {
+    cells[c].removed = true;
+  }
+
+  part0_cell_count = part1_cell_count = 0;
+  for (auto& c : cells) {
+    if (c.removed) {
+      continue;
+    }
+
+    if (!assigned[c.id]) {
+      c.partition_id = part0_cell_count > part1_cell_count;
+    }
+
+    if (!c.partition_id) {
+      part0_cell_count += c.weight;
+    }
+    else {
+      part1_cell_count += c.weight;
+    }
+  }
+}
+
+template <typename Index>
+long long BasicFMPartition<Index>::fm_eco_pass(const std::string& partition_file) {
+  // the cells' nets are only ordered where
+  // cells are freed, below
+  init(false);
+  read_partition_file(partition_file);
+
+  // balance is over the cells still in the netlist
+  CellId active_cell_count = part0_cell_count + part1_cell_count;
+  min_balance = active_cell_count * (1.0f - balance_factor) / 2.0f;
+  max_balance = active_cell_count * (1.0f + balance_factor) / 2.0f;
+  
+  for (auto& n : nets) {
+    n.update_is_cut(*this);
+  }
+  cut_size = calc_cut();
+
+  // everything is locked except the touched cells
+  // and the cells sharing a net with them, the passes
+  // only ever look at those (free_cells)
+  for (auto& c : cells) {
+    c.locked = true;
+  }
+
+  auto free_cell = [&](CellId c) {
+    if (cells[c].locked && !cells[c].removed) {
+      cells[c].locked = false;
+      free_cells.push_back(c);
+      order_cell_nets(c);
+    }
+  };
+
+  for (CellId t : eco_touched_cells) {
+    if (cells[t].removed) {
+      continue;
+    }
+    free_cell(t);
+    for (NetId n : cell_to_nets(t)) {
+      if (nets[n].is_large) {
+        continue;
+      }
+      for (CellId c : net_to_cells(n)) {
+        free_cell(c);
+      }
+    }
+  }
+
+  // in id order, as a pass over all cells would
+  // file them (the containers break ties by order)
+  std::sort(free_cells.begin(), free_cells.end());
+
+  // keep passing over the free region
+  // while it still improves
+  long long cut = cut_size;
+  while (!timed_out && !free_cells.empty()) {
+    init_gainbucket();
+    long long new_cut = fm_pass();
+    if (new_cut >= cut) {
+      break;
+    }
+    cut = new_cut;
+    if (on_pass) {
+      on_pass(cut);
+    }
+  }
+
+  stats.cut = cut;
+  return cut;
+}
+
+// "<name> <count>\n", then "c<id> " for every cell on that side and ";\n",
+// into buf (reused between calls), returns the length
+template <typename Index>
+size_t BasicFMPartition<Index>::format_group(std::vector<char>& buf, const char* name, int side, CellId count) {
+  // "c" + the digits of a CellId + " " per cell, plus the two lines around
+  buf.resize((std::numeric_limits<CellId>::digits10 + 3) * static_cast<size_t>(count) + 32);
+  char* p = buf.data();
+  char* end = buf.data() + buf.size();
+
+  while (*name) {
+    *p++ = *name++;
+  }
+  *p++ = ' ';
+  p = std::to_chars(p, end, count).ptr;
+  *p++ = '\n';
+
+  for (auto& cell : cells) {
+    if (cell.removed || cell.partition_id != side) {
+      continue;
+    }
+    *p++ = 'c';
+    p = std::to_chars(p, end, cell.id + 1).ptr;
+    *p++ = ' ';
+  }
+  *p++ = ';';
+  *p++ = '\n';
+  return p - buf.data();
+}
+
+template <typename Index>
+void BasicFMPartition<Index>::write_result(const std::string& output_file) {
+  PhaseTimer timer(stats, "write");
+  
+  long long cut_size = calc_cut(); 
+  char header[32];
+  size_t header_len = std::snprintf(header, sizeof(header), "Cutsize = %lld\n", cut_size);
+
+  CellId count[2] = {0, 0};
+  for (auto& cell : cells) {
+    if (!cell.removed) {
+      count[cell.partition_id ? 1 : 0]++;
+    }
+  }
+
+  // G1 / G2 are formatted into their own buffers,
+  // in parallel when it's worth a thread
+  size_t len[2];
+  if (parallel_write && cells.size() >= (1 << 16) && 
+      std::thread::hardware_concurrency() > 1) {
+    std::thread g2([&]() { len[1] = format_group(write_buffers[1], "G2", 1, count[1]); });
+    len[0] = format_group(write_buffers[0], "G1", 0, count[0]);
+    g2.join();
+  }
+  else {
+    len[0] = format_group(write_buffers[0], "G1", 0, count[0]);
+    len[1] = format_group(write_buffers[1], "G2", 1, count[1]);
+  }
+
+  int fd = ::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open the output file.");
+  }
+
+  // one writev for the whole file, looping only on short writes
+  struct iovec iov[3] = {
+    {header, header_len},
+    {write_buffers[0].data(), len[0]},
+    {write_buffers[1].data(), len[1]}
+  };
+  struct iovec* next = iov;
+  int left = 3;
+  while (left > 0) {
+    ssize_t n = ::writev(fd, next, left);
+    if (n < 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to write the output file.");
+    }
+    while (left > 0 && static_cast<size_t>(n) >= next->iov_len) {
+      n -= next->iov_len;
+      next++;
+      left--;
+    }
+    if (left > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + n;
+      next->iov_len -= n;
+    }
+  }
+  ::close(fd);
+}
+
+template <typename Index>
+bool BasicFMPartition<Index>::verify_result(const std::string& output_file, std::ostream& os) {
+  PhaseTimer timer(stats, "verify");
+  MappedFile file(output_file);
+  const char* p = file.data;
+  const char* end = file.data + file.size;
+
+  auto next_token = [&]() {
+    while (p < end && is_space(*p)) {
+      p++;
+    }
+    const char* token = p;
+    while (p < end && !is_space(*p)) {
+      p++;
+    }
+    return std::string(token, p);
+  };
+
+  auto to_int = [](const std::string& token) {
+    long long value = 0;
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
+  };
+
+  // the messages below are the ones checker_linux prints,
+  // typos and missing spaces included
+
+  std::string token = next_token();
+  if (token != "Cutsize") {
+    os << "Error format! line 1 is \"Cutsize\", not " << token << "\n";
+    return false;
+  }
+  token = next_token();
+  if (token != "=") {
+    os << "Error format! line 1 is \"=\", not " << token << "\n";
+    return false;
+  }
+  long long reported_cut = to_int(next_token());
+
+  // 0 = unlabeled, 1 = G1, 2 = G2
+  std::vector<char> label(cell_count, 0);
+  long long group_size[3] = {0, 0, 0};
+  bool legal = true;
+
+  for (int group = 1; group <= 2; group++) {
+    std::string name = group == 1 ? "G1" : "G2";
+    token = next_token();
+    if (token != name) {
+      os << "Error format! line " << (group == 1 ? 2 : 4) 
+         << " is \"" << name << "\", not " << token << "\n";
+      return false;
+    }
+
+    long long count = to_int(next_token());
+    for (long long i = 0; i < count; i++) {
+      token = next_token();
+      long long id = token.size() > 1 && token[0] == 'c' ? to_int(token.substr(1)) : 0;
+      if (id < 1 || id > cell_count || cells[id - 1].removed) {
+        os << "Wrong cell name! no cell has name " << token << "!!\n";
+        return false;
+      }
+      if (label[id - 1] != 0) {
+        os << "Label to " << name << " fail! cell " << token 
+           << "has been labeled to " << int(label[id - 1]) << "!\n";
+        legal = false;
+        continue;
+      }
+      label[id - 1] = group;
+      group_size[group] += cells[id - 1].weight;
+    }
+    // the ";" closing the group
+    next_token();
+  }
+
+  CellId unlabeled = 0;
+  for (CellId c = 0; c < cell_count; c++) {
+    if (label[c] == 0 && !cells[c].removed) {
+      os << "Cell c" << c + 1 << " has not been labeled!\n";
+      unlabeled++;
+    }
+  }
+  if (unlabeled > 0) {
+    os << "Unlabeled cell no = " << unlabeled << "\n";
+    return false;
+  }
+
+  // recount the cut from the labels, nets split
+  // into one range per thread
+  size_t threads = parse_threads > 0 ? 
+    parse_threads : std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<size_t>(threads, net_count / (1 << 16) + 1);
+  std::vector<long long> partial_cut(threads, 0);
+
+  auto count_cut = [&](size_t t) {
+    NetId first = static_cast<long long>(net_count) * t / threads;
+    NetId last = static_cast<long long>(net_count) * (t + 1) / threads;
+    long long cut = 0;
+    for (NetId n = first; n < last; n++) {
+      auto cs = net_to_cells(n);
+      if (cs.empty()) {
+        continue;
+      }
+      char side = label[cs[0]];
+      for (CellId c : cs) {
+        if (label[c] != side) {
+          cut += net_weight.empty() ? 1 : net_weight[n];
+          break;
+        }
+      }
+    }
+    partial_cut[t] = cut;
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; t++) {
+    workers.emplace_back(count_cut, t);
+  }
+  count_cut(0);
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  long long cut = 0;
+  for (auto c : partial_cut) {
+    cut += c;
+  }
+
+  if (!legal || cut != reported_cut) {
+    os << "Error in cut size report! not " << reported_cut << "!!\n";
+    return false;
+  }
+  os << "[Check] Cut size = " << reported_cut << " matched!\n";
+
+  bool balanced = true;
+  for (int group = 1; group <= 2; group++) {
+    if (group_size[group] < min_balance) {
+      os << "#G" << group << " < min bound !!\n";
+      balanced = false;
+    }
+    if (group_size[group] > max_balance) {
+      os << "#G" << group << " > max bound !!\n";
+      balanced = false;
+    }
+  }
+  if (!balanced) {
+    return false;
+  }
+  os << "[Check] Balance passed:: " << min_balance << "(min) < " 
+     << group_size[1] << "(G1), " << group_size[2] << "(G2) < " 
+     << max_balance << "(max) \n";
+
+  os << "=================================\n"
+     << "Congratulations! Legal Solution!!\n"
+     << "=================================\n\n";
+  return true;
+}
+
+template <typename Index>
+bool BasicFMPartition<Index>::move_keeps_balance(bool from_part, int weight) const {
+  CellId part0 = part0_cell_count + (from_part ? weight : -weight);
+  CellId part1 = part1_cell_count + (from_part ? -weight : weight);
+  return part0 >= min_balance && part1 >= min_balance &&
+    part0 <= max_balance && part1 <= max_balance;
+}
+
+template <typename Index>
+bool BasicFMPartition<Index>::is_move_balanced(CellId cell_id) {
   if (!cells[cell_id].partition_id) {
     // meaning we're moving it to partition block 1
-    int part0 = part0_cell_count - 1;
-    int part1 = part1_cell_count + 1;
+    int w = cells[cell_id].weight;
+    CellId part0 = part0_cell_count - w;
+    CellId part1 = part1_cell_count + w;
     
     if (part0 < min_balance || part1 > max_balance) {
       return false;
     } else {
-      part0_cell_count--;
-      part1_cell_count++;
+      part0_cell_count -= w;
+      part1_cell_count += w;
       return true;
     }
   }
   else {
     // we're moving it to partition block 0
-    int part0 = part0_cell_count + 1;
-    int part1 = part1_cell_count - 1;
+    int w = cells[cell_id].weight;
+    CellId part0 = part0_cell_count + w;
+    CellId part1 = part1_cell_count - w;
     if (part1 < min_balance || part0 > max_balance) {
       return false;
     }
     else {
-      part0_cell_count++;
-      part1_cell_count--;
+      part0_cell_count += w;
+      part1_cell_count -= w;
       return true;
     }
   }
 }
 
 
-void FMPartition::init_gainbucket() {
- 
-  gain_bucket.clear();
-  // TODO: for now pmax = 50 
-  // but in class I recall another pmax mentioned
-  // gain_bucket.resize(2 * net_count + 1);
-  gain_bucket.resize(2 * pmax + 1);
+template <typename Index>
+void BasicFMPartition<Index>::init_gainbucket() {
+  PhaseTimer timer(stats, "gain-init");
   
-  // populate the initial gain bucket list
-  for (auto& c : cells) {
-    
+  // with lookahead, fm_pass computes all
+  // the gain levels itself from net counts
+  if (lookahead_levels > 1 && pmax < (1 << 20)) {
+    return;
+  }
+
+  // fm_pass files every free cell
+  // under the gain computed here
+  auto init_gain = [&](Cell& c) {
     int gain = c.fs(*this) - c.te(*this);
     c.gain = gain;
     curr_max_gain = std::max(gain, curr_max_gain);
-     
-    // map this gain to the gain bucket index
-    // positive gain: bucket index = pmax - gain
-    // negative gain: bucket index = (2 * pmax + 1) - abs(gain)
-    gain_bucket[pmax - gain].insert_back(c.id);
+  };
+
+  if (!free_cells.empty()) {
+    for (CellId c : free_cells) {
+      init_gain(cells[c]);
+    }
+    return;
+  }
+  for (auto& c : cells) {
+    // locked cells never move this pass
+    if (!c.locked) {
+      init_gain(c);
+    }
   }
 }
 
-void FMPartition::dump_nets() {
-  for (const auto& e : cell_to_nets) {
-    std::cout << "Cell " << e.first << " | Partition: " << cells[e.first].partition_id << "| nets: ";
-    for (auto& n : e.second) {
+template <typename Index>
+void BasicFMPartition<Index>::dump_nets() {
+  for (CellId c = 0; c < cell_count; c++) {
+    std::cout << "Cell " << c << " | Partition: " << cells[c].partition_id << "| nets: ";
+    for (auto& n : cell_to_nets(c)) {
       std::cout << "[" << n << "|" << nets[n].is_cut << "]" << "\t";
     }
     std::cout << "\n";
   }
   
-  for (auto& e : net_to_cells) {
-    std::cout << "Net " << e.first << " | cells: ";
-    for (auto& n : e.second) {
-      std::cout << n << " ";
+  for (NetId n = 0; n < net_count; n++) {
+    std::cout << "Net " << n << " | cells: ";
+    for (auto& c : net_to_cells(n)) {
+      std::cout << c << " ";
     }
     std::cout << "\n";
   }
@@ -598,4 +2281,9 @@ void FMPartition::dump_nets() {
   std::cout << "net_count: " << net_count << "\n";
 }
 
+// the engines with_fitting_engine() picks from
+template class BasicFMPartition<NarrowIndex>;
+template class BasicFMPartition<WidePinIndex>;
+template class BasicFMPartition<WideIndex>;
+
 }
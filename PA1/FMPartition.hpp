@@ -1,93 +1,510 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <chrono>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include "FMStats.hpp"
 
 
 namespace FMPartition {
 
-const int pmax = 50;
+// how many moves fm_pass makes between
+// two looks at the clock
+const int deadline_check_interval = 1024;
+
+// the index types an engine is instantiated with: cell ids,
+// net ids and pin offsets (positions in net_pins / cell_nets,
+// one per pin); ids are signed, -1 marks "none" in places
+template <typename Cell, typename Net, typename Pin>
+struct IndexTypes {
+  using CellId = Cell;
+  using NetId = Net;
+  using PinIndex = Pin;
+};
+
+// what with_fitting_engine() picks from, narrowest first: the
+// pin offsets outgrow 32 bits first (past 4G pins), the ids only
+// past 2G cells or nets, and each step doubles what it widens
+using NarrowIndex = IndexTypes<std::int32_t, std::int32_t, std::uint32_t>;
+using WidePinIndex = IndexTypes<std::int32_t, std::int32_t, std::uint64_t>;
+using WideIndex = IndexTypes<std::int64_t, std::int64_t, std::uint64_t>;
+
+// thrown by the loaders (and apply_netlist_delta) when the
+// netlist has more cells, nets or pins than the engine's
+// index types hold, before anything is left half built
+struct IndexOverflow : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct PreprocessReport {
+  long long nets_before = 0, nets_after = 0;
+  long long pins_before = 0, pins_after = 0;
+  long long single_pin_nets = 0;
+  long long duplicate_pins = 0;
+  long long merged_nets = 0;
+};
 
-struct Cell;
-struct Net;
 struct GainBucketNode;
 struct GainBucketList;
 
-class FMPartition {
+// one row of a CSR array,
+// e.g. the pins of a net
+template <typename Id>
+struct IdRange {
+  Id* first;
+  Id* last;
+
+  Id* begin() const { return first; }
+  Id* end() const { return last; }
+  size_t size() const { return last - first; }
+  bool empty() const { return first == last; }
+  Id& operator[](size_t i) const { return first[i]; }
+};
+
+// holds fm_pass_with's gain containers (whatever type
+// the pass used) between passes; a copy of an engine
+// starts without them, so copies never share one
+struct GainContainerCache {
+  std::shared_ptr<void> containers;
+  // which fm_pass_with instantiation they belong to
+  const void* type = nullptr;
+
+  GainContainerCache() = default;
+  GainContainerCache(const GainContainerCache&) {}
+  GainContainerCache& operator=(const GainContainerCache&) {
+    containers.reset();
+    type = nullptr;
+    return *this;
+  }
+};
+
+// AUTO: dense buckets unless the gain range is
+// much wider than the netlist, then sparse buckets
+enum class GainPolicy {
+  AUTO,
+  DENSE,
+  MAP,
+  HEAP
+};
+
+// the knobs of an engine, apart from the index types, so
+// they can be set up before with_fitting_engine() picks one
+struct EngineSettings {
+  // 1 = plain FM, 2 or 3 = lookahead levels used to break ties
+  // (see BasicFMPartition::lookahead_contribution)
+  int lookahead_levels = 1;
+
+  // fm_pass stops once the best prefix hasn't grown for
+  // early_stop_moves moves (0 = never, < 0 = max(1000, 5% of
+  // the cells)) or the running gain is more than
+  // early_stop_margin (0 = off) below the best; everything
+  // after the best prefix is rolled back anyway
+  int early_stop_moves = -1;
+  int early_stop_margin = 0;
+
+  GainPolicy gain_policy = GainPolicy::AUTO;
+
+  // threads read_netlist_file() parses with,
+  // 0 means one per core
+  int parse_threads = 0;
+
+  // write_result() formats G1 and G2 on two
+  // threads for large outputs
+  bool parallel_write = true;
+
+  // nets with more pins than this are left out of
+  // gain bookkeeping (but still count towards the cut),
+  // 0 means every net takes part
+  int large_net_threshold = 0;
+};
+
+// what partition_hypergraph hands back
+struct PartitionResult {
+  // 0 or 1 for every cell
+  std::vector<int> partition;
+  long long cut = 0;
+};
+
+// partitions a hypergraph given as arrays, no files involved:
+// the pins (0-based cell ids) of net n are
+// net_pins[net_offsets[n] .. net_offsets[n+1]),
+// net_weights is optional (one per net); whatever the array
+// types, it runs on the narrowest engine the sizes fit, for
+// many small graphs in a row keep one BasicFMPartition
+// around and use reset() + load_hypergraph() instead
+PartitionResult partition_hypergraph(std::int32_t num_cells,
+  const std::vector<std::uint32_t>& net_offsets,
+  const std::vector<std::int32_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights = {});
+
+PartitionResult partition_hypergraph(std::int32_t num_cells,
+  const std::vector<std::uint64_t>& net_offsets,
+  const std::vector<std::int32_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights = {});
+
+PartitionResult partition_hypergraph(std::int64_t num_cells,
+  const std::vector<std::uint64_t>& net_offsets,
+  const std::vector<std::int64_t>& net_pins,
+  double balance_factor,
+  const std::vector<int>& net_weights = {});
+
+// the partitioner on one set of index types (see IndexTypes),
+// the narrow ones keep the netlist and the per-cell state of
+// the passes small, the wide ones take any netlist; FMPartition.cpp
+// instantiates it for NarrowIndex, WidePinIndex and WideIndex
+template <typename Index>
+class BasicFMPartition : public EngineSettings {
 public:
-  FMPartition();
+  using CellId = typename Index::CellId;
+  using NetId = typename Index::NetId;
+  using PinIndex = typename Index::PinIndex;
+
+  struct Net {
+    Net();
+    Net(NetId id);
+    NetId id;
+
+    bool is_cut;
+    // number of parallel nets merged into this one
+    int weight = 1;
+    // above large_net_threshold
+    bool is_large = false;
+    void update_is_cut(BasicFMPartition& fm);
+  };
+
+  struct Cell {
+    Cell();
+    Cell(CellId id);
+
+    int fs(BasicFMPartition& fm);
+    int te(BasicFMPartition& fm);
+    void update_gain(BasicFMPartition& fm);
+
+    CellId id;
+    // cache its gain value
+    int gain;
+    bool locked;
+    bool partition_id;
+    // dropped by a netlist delta, left out of
+    // the balance and the result
+    bool removed = false;
+    // how much it counts towards the balance,
+    // > 1 only for clusters of a coarsened netlist
+    int weight = 1;
+  };
+
+  BasicFMPartition();
+
+  // drops the netlist and partition but keeps the
+  // settings and the containers' memory, so one object
+  // can partition many netlists in a row
+  void reset();
  
   // for convenience, I also get the cell count while reading from file
   void read_netlist_file(const std::string& inputFileName);
+
+  // in-memory counterpart of read_netlist_file, 
+  // same layout as partition_hypergraph()
+  void load_hypergraph(CellId num_cells, 
+    const std::vector<PinIndex>& offsets,
+    const std::vector<CellId>& pins,
+    double balance,
+    const std::vector<int>& weights = {});
+
+  // 0 or 1 for every cell
+  std::vector<int> get_partition() const;
+
+  // derives cell_offsets / cell_nets from the net side
+  // (and the row ends of both), the loaders all end here;
+  // a cell listed twice on a net is kept once, the
+  // degree-specialized gain kernels count on it
+  void build_cell_to_nets();
+
+  // throws IndexOverflow unless that many cells, nets
+  // and pins fit CellId, NetId and PinIndex
+  static void check_index_range(unsigned long long cells, 
+    unsigned long long nets, unsigned long long pins);
+
+  // simplifies the netlist before any FM work:
+  // drops duplicated pins inside a net, drops nets
+  // left with a single pin, and merges nets with the
+  // same pins into one net whose weight is the number
+  // of copies, so the (weighted) cut stays exact;
+  // nets are renumbered, so run it before init()
+  // and not before an ECO delta
+  void preprocess_netlist();
   
-  void init();
+  // order_nets = false leaves each cell's nets in
+  // netlist order, fm_eco_pass only orders the nets
+  // of the cells it frees (see order_cell_nets)
+  void init(bool order_nets = true);
   void dump_nets();
+
+  // sorts a cell's nets by degree, fm_pass relies on
+  // the large nets coming last
+  void order_cell_nets(CellId cell);
   
   // creates an initial partition for F-M to improve
   void init_partition();
   
-  // initialize bucket gain list
+  // computes the initial gain of every free cell
   void init_gainbucket();
   
   // performs one pass of improvement
-  // returns cut size
-  int fm_pass();
+  // returns cut size, the gain container
+  // is picked by gain_policy
+  long long fm_pass();
+
+  // fm_pass on a given gain container
+  // (see FMGainContainers.hpp), Levels > 1 files
+  // cells under their packed lookahead keys
+  template <typename GainContainer, int Levels = 1>
+  long long fm_pass_with();
   
-  int fm_full_pass();
+  long long fm_full_pass();
+
+  // starts from the given partition (0/1 per cell)
+  // instead of init_partition(), books the part
+  // counts and the cut state, run after init()
+  void set_partition(const std::vector<int>& partition);
+
+  // init() + set_partition() + passes over all cells
+  // while they improve (or until the time limit),
+  // returns cut size
+  long long fm_refine(const std::vector<int>& partition);
+
+  // ECO (incremental) flow, run after read_netlist_file:
+  //
+  // applies a netlist delta, one change per line:
+  //   ADD_NET n<k> c<i> c<j> ... ;
+  //   REMOVE_NET n<k>
+  //   ADD_PIN n<k> c<i>
+  //   REMOVE_PIN n<k> c<i>
+  //   REMOVE_CELL c<i>
+  // nets are numbered the way read_netlist_file sees them
+  // (n<k> is the k-th NET line); ADD_NET / ADD_PIN may add
+  // a cell, and ADD_NET a net, as the next id after the
+  // current ones, any other unknown or malformed name
+  // throws before the netlist is changed
+  void apply_netlist_delta(const std::string& delta_file);
+
+  // reads a previous partition written by write_result
+  // (needs init() first), cells it doesn't mention
+  // go to the smaller side
+  void read_partition_file(const std::string& partition_file);
+
+  // re-partitions starting from partition_file, only the cells
+  // touched by apply_netlist_delta and their neighbours are free
+  // to move, returns cut size
+  long long fm_eco_pass(const std::string& partition_file);
   
+  // same format as always, written with a single writev
   void write_result(const std::string& output_file);
+
+  // checks output_file against the netlist in memory the
+  // way checker/checker_linux does and prints the same
+  // messages to os: every cell labeled exactly once,
+  // the reported cut (recounted in parallel) and the
+  // min_balance / max_balance bounds
+  bool verify_result(const std::string& output_file, std::ostream& os);
+
+  // formats one "G1" / "G2" section of write_result into buf
+  size_t format_group(std::vector<char>& buf, const char* name, int side, CellId count);
+
+  // gives fm_full_pass / fm_eco_pass a time budget,
+  // counted from now; passes keep running while they
+  // improve and time is left, and a pass that runs
+  // out of time stops and keeps its best prefix
+  void set_time_limit(double seconds);
+  
+  bool deadline_passed();
   
   // checks if moving a cell respects the balance criterion
-  bool is_move_balanced(int cell_id);
+  // (and if so, books the move in the part counts)
+  bool is_move_balanced(CellId cell_id);
+
+  // same check for any cell of from_part, books nothing
+  bool move_keeps_balance(bool from_part, int weight = 1) const;
 
   // cut size
-  int calc_cut();
-  
+  long long calc_cut();
+
+  // updates the gains of the free cells on net,
+  // given that cell_id is about to leave from_part;
+  // Degree selects a specialized kernel for
+  // 2-pin and 3-pin nets, 0 is the generic T(n)/F(n) loop
+  template <int Degree, typename GainContainer>
+  void update_net_gains(GainContainer* gains, CellId cell_id, NetId net, bool from_part);
+
+  // changes a free cell's gain and refiles it
+  // in its side's gain container
+  template <typename GainContainer>
+  void adjust_gain(GainContainer* gains, CellId cell_id, int delta);
+
+  // Krishnamurthy lookahead: gain level i of a free cell on side s
+  // gets +w from each net with no locked cell on s and exactly i
+  // free cells there (moving those i takes the net off s), and
+  // -w from each net with no locked cell on the other side and
+  // exactly i - 1 free cells there; level 1 is the plain FM gain
+  // (lookahead_levels picks how many levels)
+
+  // what a net with these side counts adds to the packed
+  // lookahead key of a free cell on side, level 1 alone in level1
+  template <int Levels>
+  long long lookahead_contribution(const std::array<CellId, 4>& count, 
+    int side, int w, int& level1) const;
+
+  // fm_pass with lookahead keys, picks the container
+  template <int Levels>
+  long long fm_lookahead_pass();
+
+  // builds net_side_count and lookahead_keys for a pass
+  template <int Levels>
+  void init_lookahead();
+
+  // lookahead counterpart of update_net_gains, works off
+  // the net's free/locked counts before and after the move
+  template <int Levels, typename GainContainer>
+  void update_net_lookahead(GainContainer* gains, CellId cell_id, NetId net, bool from_part);
+
+  // per net: free cells on side 0 / 1, locked cells on side 0 / 1
+  std::vector<std::array<CellId, 4>> net_side_count;
+  // per cell: the gain vector packed into one 64-bit key,
+  // level i is a digit with place value lookahead_place[i - 1]
+  // (base 2 * pmax + 1, level 1 highest), no level gets past
+  // pmax either way so keys compare like the vectors do;
+  // the sum is linear, so each net's share is simply added
+  std::vector<long long> lookahead_keys;
+  long long lookahead_place[3] = {0, 0, 0};
+
   std::vector<int> acc_gain;
-  std::vector<int> move_order;
+  std::vector<CellId> move_order;
   std::vector<Net> nets;
   std::vector<Cell> cells;
-  std::vector<GainBucketList> gain_bucket;
-  std::unordered_map<int, std::vector<int>> cell_to_nets;
-  std::unordered_map<int, std::vector<int>> net_to_cells;
+
+  // the netlist in CSR form:
+  // pins of net n are net_pins[net_offsets[n] .. net_ends[n]),
+  // nets of cell c are cell_nets[cell_offsets[c] .. cell_ends[c]);
+  // the loaders leave the rows back to back (net_ends[n] ==
+  // net_offsets[n + 1]), apply_netlist_delta rewrites a row it
+  // changes in place, or at the back of the array if it grew
+  std::vector<PinIndex> net_offsets, cell_offsets;
+  std::vector<PinIndex> net_ends, cell_ends;
+  std::vector<CellId> net_pins;
+  std::vector<NetId> cell_nets;
+
+  IdRange<CellId> net_to_cells(NetId net) {
+    return {net_pins.data() + net_offsets[net], 
+            net_pins.data() + net_ends[net]};
+  }
+
+  IdRange<NetId> cell_to_nets(CellId cell) {
+    return {cell_nets.data() + cell_offsets[cell], 
+            cell_nets.data() + cell_ends[cell]};
+  }
+
+  // pins of the netlist (net_pins can hold rows a
+  // delta replaced), set by init()
+  long long pin_count = 0;
 
   double min_balance, max_balance;
 
   double balance_factor;
   int curr_max_gain = 0;
-  int cell_count = 0, net_count = 0;
-  int part0_cell_count = 0, part1_cell_count = 0; 
-};
+  // largest |gain| any cell can reach, the gain
+  // buckets cover [-pmax, pmax], set by init()
+  int pmax = 0;
+  CellId cell_count = 0;
+  NetId net_count = 0;
+  // cell weight on each side (= cell count unless
+  // cell_weight is set)
+  CellId part0_cell_count = 0, part1_cell_count = 0; 
 
+  // per-cell weights, empty means every cell weighs 1
+  std::vector<int> cell_weight;
 
-struct Net {
-  Net();
-  Net(int id);
-  int id;
-  
-  bool is_cut;
-  void update_is_cut(FMPartition& fm);
-};
+  // write_result()'s buffers, kept around
+  std::vector<char> write_buffers[2];
 
-struct Cell {
-  Cell();
-  Cell(int id);
-  
-  int fs(FMPartition& fm);
-  int te(FMPartition& fm);
-  void update_gain(FMPartition& fm);
-
-  int id;
-  // cache its gain value
-  int gain;
-  bool locked;
-  bool partition_id;
+  // nets above large_net_threshold, and their pins
+  NetId excluded_net_count = 0;
+  long long excluded_pin_count = 0;
+
+  // net weights from preprocess_netlist(),
+  // empty means every net weighs 1
+  std::vector<int> net_weight;
+  PreprocessReport preprocess_report;
+  // pins build_cell_to_nets dropped as duplicates
+  long long dropped_duplicate_pins = 0;
+
+  // phase timings and per-pass counters
+  Stats stats;
+
+  // 0 means no time limit
+  double time_limit = 0;
+  bool timed_out = false;
+  std::chrono::steady_clock::time_point deadline;
+
+  // called by fm_full_pass / fm_refine after every pass
+  // with the cut so far, the cells hold the best partition
+  // at that point (main.cpp checkpoints from here)
+  std::function<void(long long cut)> on_pass;
+
+  // cells the netlist delta touched / removed
+  std::vector<CellId> eco_touched_cells;
+  std::vector<CellId> eco_removed_cells;
+
+  // the cells a pass may move, fm_eco_pass fills it so
+  // the gains and the gain containers of a pass only
+  // cover that region; empty means every cell (init()
+  // clears it)
+  std::vector<CellId> free_cells;
+
+  // cut of the partition in cells, kept up to date
+  // by whatever sets the nets' is_cut
+  long long cut_size = 0;
+
+  // fm_pass_with's gain containers, kept from one pass
+  // to the next while passes only cover free_cells: they
+  // are left empty and reused, so a pass over a small
+  // region doesn't set up arrays for the whole netlist
+  GainContainerCache gain_containers;
+
+  // marks nets visited in one go (a pass, a setup),
+  // net_mark[n] == mark_round means visited
+  std::vector<unsigned> net_mark;
+  unsigned mark_round = 0;
+
+  // starts a new round of net marks
+  void new_net_marks() {
+    net_mark.resize(net_count, 0);
+    mark_round++;
+  }
+
+  // marks net, true if it wasn't marked yet this round
+  bool mark_net(NetId net) {
+    if (net_mark[net] == mark_round) {
+      return false;
+    }
+    net_mark[net] = mark_round;
+    return true;
+  }
 };
 
+// the bucket lists are shared by every engine, their cell id
+// takes any CellId (the node is two pointers and padding anyway)
 struct GainBucketNode {
-  int cell_id;
-  GainBucketNode(int cell_id);
+  long long cell_id;
+  GainBucketNode(long long cell_id);
   GainBucketNode* prev, *next;  
 };
 
@@ -98,7 +515,7 @@ struct GainBucketList {
 
   ~GainBucketList();
   // inserts a new node from the back
-  void insert_back(int cell_id);
+  GainBucketNode* insert_back(long long cell_id);
 
   // move an allocated node to the back
   void move_to_back(GainBucketNode**);
@@ -107,10 +524,55 @@ struct GainBucketList {
   GainBucketNode* pop_front();
 
   // remove a node from list (by id), get the ref to it
-  GainBucketNode* remove(int cell_id);
+  GainBucketNode* remove(long long cell_id);
+
+  // unlink a node we already hold, O(1)
+  void remove(GainBucketNode* n);
 
   // dump info for debugging
   void dump(std::ostream& os) const;
 };
 
+namespace detail {
+
+// From: the narrowest index types to try, void for Index
+template <typename From, typename Index, typename... Wider, typename Load, typename Run>
+auto with_engine_of(Load& load, Run& run) {
+  if constexpr (!std::is_void_v<From> && !std::is_same_v<From, Index>) {
+    static_assert(sizeof...(Wider) > 0, "with_fitting_engine has no such index types");
+    return with_engine_of<From, Wider...>(load, run);
+  }
+  else {
+    auto fm = std::make_unique<BasicFMPartition<Index>>();
+    if constexpr (sizeof...(Wider) == 0) {
+      load(*fm);
+    }
+    else {
+      try {
+        load(*fm);
+      }
+      catch (const IndexOverflow&) {
+        // what this one loaded goes before the wider one starts
+        fm.reset();
+        return with_engine_of<void, Wider...>(load, run);
+      }
+    }
+    return run(*fm);
+  }
+}
+
+}
+
+// runs load(fm) on a fresh engine of the narrowest index types,
+// and when the netlist doesn't fit them (load throws IndexOverflow)
+// again on one of the next wider types, then returns run(fm) on
+// the engine that took it; load and run get a BasicFMPartition<>
+// of any of the types, so they are generic lambdas, and run has
+// to return the same type for all of them; From skips the
+// types before it, for callers that already tried those
+template <typename From = NarrowIndex, typename Load, typename Run>
+auto with_fitting_engine(Load&& load, Run&& run) {
+  return detail::with_engine_of<From, NarrowIndex, WidePinIndex, WideIndex>(load, run);
+}
+
 }
@@ -0,0 +1,78 @@
+#include <sys/resource.h>
+#include "FMStats.hpp"
+
+namespace FMPartition {
+
+void Stats::clear() {
+  cells = nets = cut = 0;
+  pins = 0;
+  phases.clear();
+  passes.clear();
+}
+
+long Stats::peak_rss_kb() const {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // linux reports it in kilobytes
+  return usage.ru_maxrss;
+}
+
+void Stats::write_json(std::ostream& os) const {
+  os << "{\n";
+#ifdef FM_LEAN
+  os << "  \"counters\": false,\n";
+#else
+  os << "  \"counters\": true,\n";
+#endif
+  os << "  \"cells\": " << cells << ",\n";
+  os << "  \"nets\": " << nets << ",\n";
+  os << "  \"pins\": " << pins << ",\n";
+  os << "  \"cut\": " << cut << ",\n";
+  os << "  \"peak_rss_kb\": " << peak_rss_kb() << ",\n";
+  
+  os << "  \"phases\": [";
+  for (size_t i = 0; i < phases.size(); i++) {
+    os << (i ? ",\n" : "\n")
+       << "    {\"name\": \"" << phases[i].name << "\", "
+       << "\"ms\": " << phases[i].ms << "}";
+  }
+  os << "\n  ],\n";
+  
+  os << "  \"passes\": [";
+  for (size_t i = 0; i < passes.size(); i++) {
+    const auto& p = passes[i];
+    os << (i ? ",\n" : "\n")
+       << "    {\"moves\": " << p.moves
+       << ", \"best_prefix\": " << p.best_prefix
+       << ", \"truncated\": " << (p.truncated ? "true" : "false")
+       << ", \"cut\": " << p.cut
+       << ", \"gain_updates\": " << p.gain_updates
+       << ", \"bucket_ops\": " << p.bucket_ops
+       << ", \"nets_scanned\": " << p.nets_scanned
+       << ", \"ms\": " << p.ms << "}";
+  }
+  os << "\n  ]\n";
+  os << "}\n";
+}
+
+PhaseTimer::PhaseTimer(Stats& stats, const std::string& name) :
+  _stats(stats),
+  _name(name),
+  _start(std::chrono::steady_clock::now())
+{
+
+}
+
+PhaseTimer::~PhaseTimer() {
+  _stats.phases.push_back({_name, elapsed_ms()});
+}
+
+double PhaseTimer::elapsed_ms() const {
+  std::chrono::duration<double, std::milli> d = 
+    std::chrono::steady_clock::now() - _start;
+  return d.count();
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+
+// build with -DFM_LEAN to compile the per-pass
+// counters out of the hot loops, phase timings stay
+#ifdef FM_LEAN
+#define FM_STAT(expr)
+#else
+#define FM_STAT(expr) expr
+#endif
+
+namespace FMPartition {
+
+struct PassStats {
+  long long moves = 0;
+  // length of the move prefix we kept
+  long long best_prefix = 0;
+  // stopped early (EngineSettings::early_stop_moves / _margin)
+  bool truncated = false;
+  long long cut = 0;
+  long long gain_updates = 0;
+  long long bucket_ops = 0;
+  long long nets_scanned = 0;
+  double ms = 0;
+};
+
+struct PhaseStats {
+  std::string name;
+  double ms;
+};
+
+struct Stats {
+  long long cells = 0, nets = 0;
+  long long pins = 0;
+  long long cut = 0;
+  std::vector<PhaseStats> phases;
+  std::vector<PassStats> passes;
+  
+  void clear();
+
+  // peak resident set size of this process
+  long peak_rss_kb() const;
+  
+  void write_json(std::ostream& os) const;
+};
+
+// records the time between its construction
+// and destruction as one phase
+class PhaseTimer {
+public:
+  PhaseTimer(Stats& stats, const std::string& name);
+  ~PhaseTimer();
+
+  double elapsed_ms() const;
+
+private:
+  Stats& _stats;
+  std::string _name;
+  std::chrono::steady_clock::time_point _start;
+};
+
+}
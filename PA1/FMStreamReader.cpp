@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include "FMStreamReader.hpp"
+
+#ifdef FM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef FM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace FMPartition {
+
+namespace {
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() && 
+    s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+bool is_compressed_netlist(const std::string& file_name) {
+  return ends_with(file_name, ".gz") || ends_with(file_name, ".zst");
+}
+
+DecompressingReader::DecompressingReader(const std::string& file_name,
+  size_t buffer_count, size_t buffer_size) :
+  _slots(buffer_count)
+{
+  for (auto& slot : _slots) {
+    slot.data.resize(buffer_size);
+  }
+
+  // the file is opened here so a missing file
+  // throws right away, not on the first next()
+  if (ends_with(file_name, ".gz")) {
+#ifdef FM_HAVE_ZLIB
+    gzFile gz = gzopen(file_name.c_str(), "rb");
+    if (gz == nullptr) {
+      throw std::runtime_error("failed to open this file.");
+    }
+    gzbuffer(gz, 1 << 18);
+    _read = [gz](char* dst, size_t size) -> size_t {
+      int n = gzread(gz, dst, static_cast<unsigned>(size));
+      // a truncated file shows up as an error at the end
+      int errnum = Z_OK;
+      const char* msg = gzerror(gz, &errnum);
+      if (n < 0 || (errnum != Z_OK && errnum != Z_STREAM_END)) {
+        throw std::runtime_error(std::string("gzip: ") + msg);
+      }
+      return n;
+    };
+    _close = [gz]() { gzclose(gz); };
+#else
+    throw std::runtime_error("built without zlib, can't read " + file_name);
+#endif
+  }
+  else if (ends_with(file_name, ".zst")) {
+#ifdef FM_HAVE_ZSTD
+    FILE* fp = std::fopen(file_name.c_str(), "rb");
+    if (fp == nullptr) {
+      throw std::runtime_error("failed to open this file.");
+    }
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    // compressed bytes read from fp but not decompressed yet
+    auto in_data = std::make_shared<std::vector<char>>(ZSTD_DStreamInSize());
+    auto in = std::make_shared<ZSTD_inBuffer>(ZSTD_inBuffer{in_data->data(), 0, 0});
+    // 0 once a frame is complete
+    auto frame_left = std::make_shared<size_t>(0);
+
+    _read = [fp, dctx, in_data, in, frame_left](char* dst, size_t size) -> size_t {
+      ZSTD_outBuffer out{dst, size, 0};
+      while (out.pos < out.size) {
+        if (in->pos == in->size) {
+          in->size = std::fread(in_data->data(), 1, in_data->size(), fp);
+          in->pos = 0;
+          if (in->size == 0) {
+            if (*frame_left != 0) {
+              throw std::runtime_error("zstd: truncated input");
+            }
+            break;
+          }
+        }
+        size_t ret = ZSTD_decompressStream(dctx, &out, in.get());
+        if (ZSTD_isError(ret)) {
+          throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(ret));
+        }
+        *frame_left = ret;
+      }
+      return out.pos;
+    };
+    _close = [fp, dctx]() {
+      ZSTD_freeDCtx(dctx);
+      std::fclose(fp);
+    };
+#else
+    throw std::runtime_error("built without zstd, can't read " + file_name);
+#endif
+  }
+  else {
+    throw std::runtime_error("not a compressed netlist: " + file_name);
+  }
+
+  _thread = std::thread(&DecompressingReader::_produce, this);
+}
+
+DecompressingReader::~DecompressingReader() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+  if (_close) {
+    _close();
+  }
+}
+
+void DecompressingReader::_produce() {
+  try {
+    while (true) {
+      Slot* slot;
+      {
+        // wait for a slot the caller is done with
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&]() { return _stop || _filled - _released < _slots.size(); });
+        if (_stop) {
+          return;
+        }
+        slot = &_slots[_filled % _slots.size()];
+      }
+
+      // fill the whole slot, fewer and larger
+      // pieces are cheaper for the tokenizer
+      slot->size = 0;
+      while (slot->size < slot->data.size()) {
+        size_t n = _read(slot->data.data() + slot->size, slot->data.size() - slot->size);
+        if (n == 0) {
+          break;
+        }
+        slot->size += n;
+      }
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (slot->size == 0) {
+        _done = true;
+        _cv.notify_all();
+        return;
+      }
+      _filled++;
+      _cv.notify_all();
+    }
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _error = std::current_exception();
+    _done = true;
+    _cv.notify_all();
+  }
+}
+
+bool DecompressingReader::next(const char*& data, size_t& size) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (_holding) {
+    _released++;
+    _holding = false;
+    _cv.notify_all();
+  }
+
+  _cv.wait(lock, [&]() { return _done || _filled > _released; });
+  if (_filled > _released) {
+    Slot& slot = _slots[_released % _slots.size()];
+    data = slot.data.data();
+    size = slot.size;
+    _holding = true;
+    return true;
+  }
+
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+
+namespace FMPartition {
+
+// true for the netlist names read_netlist_file()
+// decompresses on the fly: *.gz and *.zst
+bool is_compressed_netlist(const std::string& file_name);
+
+// decompresses a .gz / .zst file on a background thread
+// into a small ring of buffers while the caller parses
+// the ones already filled, so nothing goes through disk
+//
+// gzip needs FM_HAVE_ZLIB and zstd needs FM_HAVE_ZSTD
+// at compile time (CMake sets them when the libraries
+// are found), otherwise the constructor throws
+class DecompressingReader {
+public:
+  explicit DecompressingReader(const std::string& file_name,
+    size_t buffer_count = 4, size_t buffer_size = 1 << 22);
+  ~DecompressingReader();
+
+  DecompressingReader(const DecompressingReader&) = delete;
+  DecompressingReader& operator=(const DecompressingReader&) = delete;
+
+  // hands out the next piece of decompressed data,
+  // valid until the next call, false at the end,
+  // rethrows what went wrong on the decompression thread
+  bool next(const char*& data, size_t& size);
+
+private:
+  struct Slot {
+    std::vector<char> data;
+    size_t size = 0;
+  };
+
+  void _produce();
+
+  // fills up to size bytes, 0 at the end of the input
+  std::function<size_t(char*, size_t)> _read;
+  std::function<void()> _close;
+
+  std::vector<Slot> _slots;
+  // slots filled / slots given back, both only grow,
+  // slot i lives at _slots[i % _slots.size()]
+  size_t _filled = 0;
+  size_t _released = 0;
+  // the caller holds slot _released
+  bool _holding = false;
+  bool _done = false;
+  bool _stop = false;
+  std::exception_ptr _error;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::thread _thread;
+};
+
+}
@@ -0,0 +1,83 @@
+// runs fm_full_pass on each input and records per-phase
+// throughput and the resulting cut, one CSV row per input
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "../FMPartition.hpp"
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: ./fm_bench [results.csv] [input.dat]... "
+              << "[--time-limit seconds]" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  double time_limit = 0;
+  std::vector<std::string> inputs;
+  for (int i = 2; i < argc; i++) {
+    if (std::strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+      time_limit = std::stod(argv[++i]);
+    }
+    else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  std::ofstream csv(argv[1]);
+  csv << "input,cells,nets,pins,parse_ms,init_ms,gain_init_ms,pass_ms,"
+      << "passes,moves,parse_mpins_per_s,pass_mmoves_per_s,cut,peak_rss_kb\n";
+
+  for (const auto& input : inputs) {
+    // each input gets the engine with the narrowest index types it fits
+    auto load = [&](auto& fm) {
+      if (time_limit > 0) {
+        fm.set_time_limit(time_limit);
+      }
+      fm.read_netlist_file(input);
+    };
+    FMPartition::with_fitting_engine(load, [&](auto& fm) {
+      long long cut = fm.fm_full_pass();
+
+      double parse_ms = 0, init_ms = 0, gain_init_ms = 0, pass_ms = 0;
+      for (const auto& p : fm.stats.phases) {
+        if (p.name == "parse") {
+          parse_ms += p.ms;
+        }
+        else if (p.name == "init") {
+          init_ms += p.ms;
+        }
+        else if (p.name == "gain-init") {
+          gain_init_ms += p.ms;
+        }
+        else if (p.name == "pass") {
+          pass_ms += p.ms;
+        }
+      }
+
+      long long moves = 0;
+      for (const auto& p : fm.stats.passes) {
+        moves += p.moves;
+      }
+
+      csv << input << ","
+          << fm.stats.cells << ","
+          << fm.stats.nets << ","
+          << fm.stats.pins << ","
+          << parse_ms << ","
+          << init_ms << ","
+          << gain_init_ms << ","
+          << pass_ms << ","
+          << fm.stats.passes.size() << ","
+          << moves << ","
+          << fm.stats.pins / (parse_ms * 1000.0) << ","
+          << moves / (pass_ms * 1000.0) << ","
+          << cut << ","
+          << fm.stats.peak_rss_kb() << "\n";
+    
+      std::cout << input << ": cut " << cut << ", " 
+                << parse_ms + init_ms + gain_init_ms + pass_ms << " ms\n";
+    });
+  }
+
+  return 0;
+}
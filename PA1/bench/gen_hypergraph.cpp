@@ -0,0 +1,214 @@
+// generates reproducible hypergraphs in the PA1 .dat format
+// with a Rent's rule style locality structure
+//
+// cells sit at the leaves of a binary hierarchy, a net first picks
+// its degree, then the level of the smallest block that contains it
+// (level L with weight ~ 2^(L * (rent - 1)), which gives about
+// t * B^rent external nets for a block of B cells), and then draws its
+// pins inside a random block of that level, one from each half
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+
+struct GenOptions {
+  long long pins = 100000;
+  long long cells = 0;
+  double rent = 0.65;
+  double degree_exp = 2.5;
+  int max_degree = 32;
+  double balance = 0.1;
+  unsigned long long seed = 1;
+};
+
+// appends to a large buffer and only
+// touches the stream when it's full
+class DatWriter {
+public:
+  DatWriter(std::ofstream& ofs) : _ofs(ofs) {
+    _buf.reserve(1 << 20);
+  }
+  
+  ~DatWriter() {
+    flush();
+  }
+
+  void put(const char* s) {
+    _buf.append(s);
+  }
+
+  void put(long long v) {
+    char tmp[24];
+    auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    _buf.append(tmp, r.ptr);
+  }
+
+  void end_line() {
+    _buf.push_back('\n');
+    if (_buf.size() > (1 << 20) - 256) {
+      flush();
+    }
+  }
+
+  void flush() {
+    _ofs.write(_buf.data(), _buf.size());
+    _buf.clear();
+  }
+
+private:
+  std::ofstream& _ofs;
+  std::string _buf;
+};
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: ./gen_hypergraph [output.dat] "
+              << "[--pins P] [--cells N] [--rent p] [--degree-exp a] "
+              << "[--max-degree D] [--balance b] [--seed s]" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  GenOptions opt;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--pins") == 0) {
+      opt.pins = std::stoll(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--cells") == 0) {
+      opt.cells = std::stoll(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--rent") == 0) {
+      opt.rent = std::stod(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--degree-exp") == 0) {
+      opt.degree_exp = std::stod(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--max-degree") == 0) {
+      opt.max_degree = std::stoi(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--balance") == 0) {
+      opt.balance = std::stod(argv[i + 1]);
+    }
+    else if (std::strcmp(argv[i], "--seed") == 0) {
+      opt.seed = std::stoull(argv[i + 1]);
+    }
+    else {
+      std::cerr << "unknown option: " << argv[i] << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  // about 3.5 pins per cell, like most netlists
+  if (opt.cells == 0) {
+    opt.cells = std::max(4LL, static_cast<long long>(opt.pins / 3.5));
+  }
+  opt.max_degree = std::max(2LL, std::min<long long>(opt.max_degree, opt.cells));
+
+  std::mt19937_64 rng(opt.seed);
+
+  // net degree: P(d) ~ d^-degree_exp on [2, max_degree]
+  std::vector<double> degree_weights(opt.max_degree + 1, 0.0);
+  for (int d = 2; d <= opt.max_degree; d++) {
+    degree_weights[d] = std::pow(d, -opt.degree_exp);
+  }
+  std::discrete_distribution<int> degree_dist(degree_weights.begin(), degree_weights.end());
+
+  // hierarchy levels, block size 2^L
+  int levels = 1;
+  while ((1LL << levels) < opt.cells) {
+    levels++;
+  }
+
+  // one level distribution per minimum level,
+  // a net of degree d can't live below ceil(log2(d))
+  std::vector<std::discrete_distribution<int>> level_dist(levels + 1);
+  for (int min_level = 1; min_level <= levels; min_level++) {
+    std::vector<double> w(levels + 1, 0.0);
+    for (int l = min_level; l <= levels; l++) {
+      w[l] = std::pow(2.0, l * (opt.rent - 1.0));
+    }
+    level_dist[min_level] = std::discrete_distribution<int>(w.begin(), w.end());
+  }
+
+  // cells are renamed randomly on output, otherwise the
+  // hierarchy order would hand fm its answer in init_partition
+  std::vector<long long> name(opt.cells);
+  for (long long i = 0; i < opt.cells; i++) {
+    name[i] = i + 1;
+  }
+  std::shuffle(name.begin(), name.end(), rng);
+
+  std::ofstream ofs(argv[1], std::ios::binary);
+  if (!ofs) {
+    std::cerr << "failed to open " << argv[1] << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  
+  DatWriter out(ofs);
+  ofs << opt.balance << "\n";
+
+  std::vector<char> used(opt.cells, 0);
+  std::vector<long long> pins;
+  long long pin_count = 0, net_count = 0;
+
+  auto write_net = [&](const std::vector<long long>& ps) {
+    out.put("NET n");
+    out.put(++net_count);
+    for (long long p : ps) {
+      out.put(" c");
+      out.put(name[p]);
+      used[p] = 1;
+    }
+    out.put(" ;");
+    out.end_line();
+    pin_count += ps.size();
+  };
+
+  while (pin_count < opt.pins) {
+    int degree = degree_dist(rng);
+    
+    int min_level = 1;
+    while ((1LL << min_level) < degree) {
+      min_level++;
+    }
+    int level = level_dist[std::min(min_level, levels)](rng);
+
+    // a random block of that level, clipped to the cell count
+    long long block_size = 1LL << level;
+    long long blocks = std::max(1LL, opt.cells / block_size);
+    long long start = std::uniform_int_distribution<long long>(0, blocks - 1)(rng) * block_size;
+    long long end = std::min(start + block_size, opt.cells);
+    long long half = start + (end - start) / 2;
+    degree = std::min<long long>(degree, end - start);
+
+    pins.clear();
+    pins.push_back(std::uniform_int_distribution<long long>(start, half - 1)(rng));
+    pins.push_back(std::uniform_int_distribution<long long>(half, end - 1)(rng));
+    std::uniform_int_distribution<long long> in_block(start, end - 1);
+    while (static_cast<int>(pins.size()) < degree) {
+      long long p = in_block(rng);
+      if (std::find(pins.begin(), pins.end(), p) == pins.end()) {
+        pins.push_back(p);
+      }
+    }
+
+    write_net(pins);
+  }
+
+  // every cell has to show up in the netlist,
+  // tie the leftovers to a leaf neighbour
+  for (long long c = 0; c < opt.cells; c++) {
+    if (!used[c]) {
+      write_net({c, (c ^ 1) < opt.cells ? (c ^ 1) : c - 1});
+    }
+  }
+
+  out.flush();
+  std::cerr << "wrote " << argv[1] << ": " << opt.cells << " cells, "
+            << net_count << " nets, " << pin_count << " pins\n";
+  return 0;
+}
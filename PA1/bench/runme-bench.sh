@@ -0,0 +1,35 @@
+#!/bin/bash
+# builds the generator and the harness, generates a
+# scaling series and writes bench_results.csv
+#
+# usage: ./runme-bench.sh [max_pins] [rent] [seed]
+# (max_pins defaults to 10M, the generator goes up to 50M and beyond)
+set -e
+cd "$(dirname "$0")"
+
+MAX_PINS=${1:-10000000}
+RENT=${2:-0.65}
+SEED=${3:-1}
+
+# the compiler, flags, libraries and sources of the fm build
+FM_DIR=..
+FM_SETTINGS_ONLY=1
+. ../runme-compile.sh
+
+$FM_CXX $FM_FLAGS gen_hypergraph.cpp -o gen_hypergraph
+$FM_CXX $FM_FLAGS fm_bench.cpp $FM_SOURCES -o fm_bench $FM_LIBS
+
+mkdir -p graphs
+inputs=()
+for pins in 10000 100000 1000000 10000000 50000000; do
+  if [ "$pins" -gt "$MAX_PINS" ]; then
+    break
+  fi
+  f=graphs/rent_${RENT}_${pins}_${SEED}.dat
+  if [ ! -f "$f" ]; then
+    ./gen_hypergraph "$f" --pins "$pins" --rent "$RENT" --seed "$SEED"
+  fi
+  inputs+=("$f")
+done
+
+./fm_bench bench_results.csv "${inputs[@]}" ../input_pa1/input_1.dat ../input_pa1/input_2.dat ../input_pa1/input_3.dat
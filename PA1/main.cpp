@@ -1,28 +1,297 @@
 #include "FMPartition.hpp"
+#include "FMBatch.hpp"
+#include "FMMemetic.hpp"
+#include "FMCheckpoint.hpp"
 #include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <memory>
 
 int main(int argc, char* argv[]) {
-  if (argc != 3) {
-    std::cerr << "Usage: ./exec [input_file] [output_file]" << std::endl;
+  // batch mode: ./exec --batch [manifest] [summary] [--threads N] ...
+  if (argc >= 4 && std::strcmp(argv[1], "--batch") == 0) {
+    FMPartition::BatchOptions options;
+    for (int i = 4; i < argc; i++) {
+      if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+        options.threads = std::stoi(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--large-net-threshold") == 0 && i + 1 < argc) {
+        options.large_net_threshold = std::stoi(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+        options.time_limit = std::stod(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--no-preprocess") == 0) {
+        options.preprocess = false;
+      }
+      else if (std::strcmp(argv[i], "--verify") == 0) {
+        options.verify = true;
+      }
+      else {
+        std::cerr << "unknown option: " << argv[i] << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+    }
+
+    auto start_time = std::chrono::steady_clock::now(); 
+    auto jobs = FMPartition::read_batch_manifest(argv[2]);
+    FMPartition::run_batch(jobs, options);
+    
+    std::ofstream ofs(argv[3]);
+    FMPartition::write_batch_summary(ofs, jobs);
+    
+    std::chrono::duration<double, std::milli> elapsed_time = 
+      std::chrono::steady_clock::now() - start_time;  
+    std::cout << jobs.size() << " jobs, run time: " 
+      << elapsed_time.count()
+      << " ms\n";
+    return 0;
+  }
+
+  if (argc < 3) {
+    std::cerr << "Usage: ./exec [input_file] [output_file] "
+              << "[--large-net-threshold N] "
+              << "[--eco previous_output delta_file] "
+              << "[--time-limit seconds] "
+              << "[--stats stats.json] [--no-preprocess] "
+              << "[--gain-container auto|dense|map|heap] "
+              << "[--parse-threads N] [--verify] [--lookahead 1|2|3] "
+              << "[--early-stop K] [--early-stop-margin M] "
+              << "[--memetic seconds [--threads N]] "
+              << "[--checkpoint file [--checkpoint-interval seconds]] "
+              << "[--resume file]\n"
+              << "       ./exec --batch [manifest] [summary] "
+              << "[--threads N] [--large-net-threshold N] "
+              << "[--time-limit seconds] [--no-preprocess] [--verify]" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // set on whichever engine the netlist fits, see below
+  FMPartition::EngineSettings settings;
+  std::string eco_partition_file, eco_delta_file;
+  double time_limit = 0;
+  std::string stats_file;
+  bool preprocess = true;
+  bool verify = false;
+  FMPartition::MemeticOptions memetic;
+  memetic.time_limit = 0;
+  std::string checkpoint_file, resume_file;
+  double checkpoint_interval = 60;
+
+  for (int i = 3; i < argc; i++) {
+    if (std::strcmp(argv[i], "--large-net-threshold") == 0 && i + 1 < argc) {
+      settings.large_net_threshold = std::stoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--eco") == 0 && i + 2 < argc) {
+      eco_partition_file = argv[++i];
+      eco_delta_file = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) {
+      time_limit = std::stod(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+      stats_file = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--no-preprocess") == 0) {
+      preprocess = false;
+    }
+    else if (std::strcmp(argv[i], "--verify") == 0) {
+      verify = true;
+    }
+    else if (std::strcmp(argv[i], "--lookahead") == 0 && i + 1 < argc) {
+      settings.lookahead_levels = std::clamp(std::stoi(argv[++i]), 1, 3);
+    }
+    else if (std::strcmp(argv[i], "--early-stop") == 0 && i + 1 < argc) {
+      settings.early_stop_moves = std::stoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--early-stop-margin") == 0 && i + 1 < argc) {
+      settings.early_stop_margin = std::stoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--memetic") == 0 && i + 1 < argc) {
+      memetic.time_limit = std::stod(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      memetic.threads = std::stoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+      checkpoint_file = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc) {
+      checkpoint_interval = std::stod(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+      resume_file = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--parse-threads") == 0 && i + 1 < argc) {
+      settings.parse_threads = std::stoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--gain-container") == 0 && i + 1 < argc) {
+      std::string policy = argv[++i];
+      if (policy == "dense") {
+        settings.gain_policy = FMPartition::GainPolicy::DENSE;
+      }
+      else if (policy == "map") {
+        settings.gain_policy = FMPartition::GainPolicy::MAP;
+      }
+      else if (policy == "heap") {
+        settings.gain_policy = FMPartition::GainPolicy::HEAP;
+      }
+      else {
+        settings.gain_policy = FMPartition::GainPolicy::AUTO;
+      }
+    }
+    else {
+      std::cerr << "unknown option: " << argv[i] << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!eco_delta_file.empty() && (!checkpoint_file.empty() || !resume_file.empty())) {
+    std::cerr << "--checkpoint / --resume don't apply to --eco" << std::endl;
     std::exit(EXIT_FAILURE);
   }
 
-  FMPartition::FMPartition fm;
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now(); 
+
+  // read before the netlist, a bad checkpoint
+  // shouldn't cost a parse
+  FMPartition::Checkpoint resume;
+  if (!resume_file.empty()) {
+    resume = FMPartition::read_checkpoint(resume_file);
+  }
+  std::unique_ptr<FMPartition::CheckpointWriter> checkpoint_writer;
+  if (!checkpoint_file.empty()) {
+    checkpoint_writer = std::make_unique<FMPartition::CheckpointWriter>(
+      checkpoint_file, checkpoint_interval);
+  }
+
+  // the netlist (and the delta) goes into the engine with the
+  // narrowest index types it fits, a netlist too big for one
+  // is read again by the next
+  auto load = [&](auto& fm) {
+    static_cast<FMPartition::EngineSettings&>(fm) = settings;
+    if (time_limit > 0) {
+      // what's left of it after an engine that didn't fit
+      std::chrono::duration<double> spent = std::chrono::steady_clock::now() - start_time;
+      fm.set_time_limit(std::max(time_limit - spent.count(), 1e-3));
+    }
+    fm.read_netlist_file(argv[1]); 
+    if (!eco_delta_file.empty()) {
+      // the delta refers to the original net numbering,
+      // so no preprocessing here
+      fm.apply_netlist_delta(eco_delta_file);
+    }
+  };
+
+  auto run = [&](auto& fm) {
+    long long cut;
+    if (!eco_delta_file.empty()) {
+      cut = fm.fm_eco_pass(eco_partition_file);
+    }
+    else {
+      if (preprocess) {
+        fm.preprocess_netlist();
+        // on stderr, stdout keeps the format the
+        // grading scripts read
+        const auto& r = fm.preprocess_report;
+        std::cerr << "preprocess: nets " << r.nets_before << " -> " << r.nets_after
+          << ", pins " << r.pins_before << " -> " << r.pins_after
+          << " (" << r.single_pin_nets << " single-pin nets, "
+          << r.duplicate_pins << " duplicate pins, "
+          << r.merged_nets << " merged nets)\n";
+      }
+      if (memetic.time_limit > 0) {
+        memetic.checkpoint = checkpoint_writer.get();
+        memetic.resume = resume_file.empty() ? nullptr : &resume;
+        auto r = FMPartition::memetic_partition(fm, memetic);
+        std::cout << "memetic: " << r.starts << " starts (best cut " 
+          << r.best_start_cut << "), " << r.offspring << " offspring, "
+          << r.improvements << " improvements\n";
+        cut = r.cut;
+      }
+      else if (checkpoint_writer || !resume_file.empty()) {
+        FMPartition::Checkpoint checkpoint;
+        checkpoint.cell_count = fm.cell_count;
+        checkpoint.fingerprint = FMPartition::netlist_fingerprint(fm);
+        if (!resume_file.empty()) {
+          if (resume.mode != FMPartition::Checkpoint::Mode::PASSES || 
+            resume.fingerprint != checkpoint.fingerprint) {
+            std::cerr << resume_file << " is not a checkpoint of FM passes on "
+              << argv[1] << std::endl;
+            std::exit(EXIT_FAILURE);
+          }
+          checkpoint.passes = resume.passes;
+          checkpoint.elapsed = resume.elapsed;
+          checkpoint.resumes = resume.resumes + 1;
+        }
+
+        auto offer = [&](long long pass_cut) {
+          std::chrono::duration<double> session = 
+            std::chrono::steady_clock::now() - start_time;
+          FMPartition::Checkpoint c = checkpoint;
+          c.elapsed += session.count();
+          c.cut = pass_cut;
+          c.partition = fm.get_partition();
+          checkpoint_writer->offer(c);
+        };
+        fm.on_pass = [&](long long pass_cut) {
+          checkpoint.passes++;
+          if (checkpoint_writer && checkpoint_writer->due()) {
+            offer(pass_cut);
+          }
+        };
+
+        // the saved partition is the best one so far,
+        // passes go on from there
+        cut = resume_file.empty() ? 
+          fm.fm_full_pass() : fm.fm_refine(resume.partition);
+        if (checkpoint_writer) {
+          offer(cut);
+        }
+        std::cout << "passes: " << checkpoint.passes << " over " 
+          << checkpoint.resumes + 1 << " run(s)\n";
+      }
+      else {
+        cut = fm.fm_full_pass();
+      }
+    }
+    std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now(); 
+    
+    std::cout << "cut size: " << cut << "\n";
+    if (fm.timed_out) {
+      std::cout << "time limit reached, writing the best partition so far\n";
+    }
+    if (fm.large_net_threshold > 0) {
+      std::cout << "large nets excluded from gains: " 
+        << fm.excluded_net_count << " nets, "
+        << fm.excluded_pin_count << " pins (degree > " 
+        << fm.large_net_threshold << ")\n";
+    }
+    fm.write_result(argv[2]);
+
+    std::chrono::duration<double, std::milli> elapsed_time = end_time - start_time;  
+    std::cout << "Run time: " 
+      << elapsed_time.count()
+      << " ms\n";
 
-  std::chrono::steady_clock::time_point start_time, end_time; 
-  start_time = std::chrono::steady_clock::now(); 
+    bool legal = !verify || fm.verify_result(argv[2], std::cout);
 
-  fm.read_netlist_file(argv[1]); 
-  int cut = fm.fm_full_pass();
-  end_time = std::chrono::steady_clock::now(); 
-  
-  std::cout << "cut size: " << cut << "\n";
-  fm.write_result(argv[2]);
+    if (checkpoint_writer) {
+      // waits for the last checkpoint to be on disk
+      checkpoint_writer->close();
+      if (!checkpoint_writer->error().empty()) {
+        std::cerr << checkpoint_writer->error() << std::endl;
+      }
+    }
 
-  std::chrono::duration<double, std::milli> elapsed_time = end_time - start_time;  
-  std::cout << "Run time: " 
-    << elapsed_time.count()
-    << " ms\n";
+    if (!stats_file.empty()) {
+      std::ofstream ofs(stats_file);
+      fm.stats.write_json(ofs);
+    }
+    return legal;
+  };
 
-  return 0;
+  bool legal = FMPartition::with_fitting_engine(load, run);
+  return legal ? 0 : EXIT_FAILURE;
 }
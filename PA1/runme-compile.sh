@@ -1 +1,30 @@
-clang++ -O3 FMPartition.cpp main.cpp -o fm
+# the one build of fm: all_testcases.sh runs this script, and
+# bench/runme-bench.sh sources it with FM_SETTINGS_ONLY=1 (and
+# FM_DIR pointing here) to build the same sources the same way
+
+FM_DIR=${FM_DIR:-$(dirname "$0")}
+
+# $CXX if set, else clang++, else g++
+FM_CXX=${CXX:-clang++}
+command -v "$FM_CXX" >/dev/null 2>&1 || FM_CXX=g++
+
+FM_FLAGS="-O3 -std=c++17 -pthread"
+
+# .gz / .zst netlists need zlib / zstd,
+# build them in when installed (like CMakeLists.txt)
+FM_LIBS=""
+has_lib() {
+  echo 'int main() {}' | $FM_CXX -x c++ -include "$1" - "$2" -o /dev/null 2>/dev/null
+}
+has_lib zlib.h -lz && FM_LIBS="$FM_LIBS -DFM_HAVE_ZLIB -lz"
+has_lib zstd.h -lzstd && FM_LIBS="$FM_LIBS -DFM_HAVE_ZSTD -lzstd"
+
+# everything but main.cpp
+FM_SOURCES=""
+for f in FMPartition.cpp FMStats.cpp FMBatch.cpp FMStreamReader.cpp FMMemetic.cpp FMCheckpoint.cpp; do
+  FM_SOURCES="$FM_SOURCES $FM_DIR/$f"
+done
+
+if [ -z "$FM_SETTINGS_ONLY" ]; then
+  $FM_CXX $FM_FLAGS $FM_SOURCES "$FM_DIR/main.cpp" -o "$FM_DIR/fm" $FM_LIBS
+fi
@@ -0,0 +1,53 @@
+#include "floorplanner.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// with FP_COUNT_ALLOCATIONS, replaces the global operator new
+// (the array and nothrow forms go through it) to count heap
+// allocations, e.g. to check that a simulated annealing move
+// doesn't make any; without it the allocator is left alone
+
+#ifdef FP_COUNT_ALLOCATIONS
+
+namespace {
+
+std::atomic<std::size_t> allocations{0};
+
+}
+
+void* operator new(std::size_t n) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n == 0 ? 1 : n)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+namespace floorplanner {
+
+std::size_t heap_allocations() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+}
+
+#else
+
+namespace floorplanner {
+
+std::size_t heap_allocations() {
+	return 0;
+}
+
+}
+
+#endif
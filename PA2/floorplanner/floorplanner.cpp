@@ -6,10 +6,33 @@
 #include <cctype>
 #include <locale>
 #include <algorithm>
+#include <cmath>
 #include <cassert>
+#include <limits>
+#include <random>
 
 namespace floorplanner {
 
+namespace {
+
+// log(i / 256) for i = 0..256: a u in the i-th 256th of (0, 1]
+// has log(u) between edge[i] and edge[i + 1], so most acceptance
+// tests are settled by two compares and never call log
+struct LogEdges {
+	double edge[257];
+
+	LogEdges() {
+		edge[0] = -std::numeric_limits<double>::infinity();
+		for (int i = 1; i <= 256; i++) {
+			edge[i] = std::log(i / 256.0);
+		}
+	}
+};
+
+const LogEdges log_edges;
+
+}
+
 static inline void rtrim(std::string &s) {
   s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
       return !std::isspace(ch);
@@ -17,13 +40,34 @@ static inline void rtrim(std::string &s) {
 } 
 
 
+// random_device where it works (it may throw), mixed
+// with the clock and the address so runs differ even
+// without it
+std::uint64_t random_seed(const void* p) {
+	std::uint64_t seed = static_cast<std::uint64_t>(
+		std::chrono::system_clock::now().time_since_epoch().count());
+	seed ^= reinterpret_cast<std::uintptr_t>(p);
+	try {
+		std::random_device rd;
+		seed ^= (static_cast<std::uint64_t>(rd()) << 32) | rd();
+	}
+	catch (const std::exception&) {
+	}
+	return seed;
+}
+
 FloorPlanner::FloorPlanner() :
-	_rng(_rd()),
 	initial_temp(20000.0),
 	moves_per_temp(20000)
 {
-	_uni_real_dist = std::uniform_real_distribution<double>(0, 1);
-	_uni_int_dist03 = std::uniform_int_distribution<int>(0, 3);
+	seed_rng(random_seed(this));
+}
+
+void FloorPlanner::seed_rng(std::uint64_t seed, int stream) {
+	_rng.seed(seed);
+	for (int i = 0; i < stream; i++) {
+		_rng.jump();
+	}
 }
 
 
@@ -77,6 +121,13 @@ void FloorPlanner::read_input(const std::string& a, const std::string& blk_file,
     _name_to_macro.insert(std::make_pair(blk_name, blk));
   }
 
+  _blk_w.resize(n_blks);
+  _blk_h.resize(n_blks);
+  for (int blk = 0; blk < n_blks; blk++) {
+    _blk_w[blk] = _macros[blk].w;
+    _blk_h[blk] = _macros[blk].h;
+  }
+
   std::string blk_x, blk_y;
   // read in terminals
   for (int term = 0; term < n_terms; term++) {
@@ -113,8 +164,26 @@ void FloorPlanner::read_input(const std::string& a, const std::string& blk_file,
     }
   }
 
-	_uni_int_dist = std::uniform_int_distribution(0, n_blks - 1);
+  // the other way round, for the incremental hpwl
+  _macro_to_nets.assign(n_blks + n_terms, {});
+  for (int i = 0; i < n_nets; i++) {
+    for (int m : _net_to_macros[i]) {
+      _macro_to_nets[m].push_back(i);
+    }
+  }
+
 	ifs.close();
+
+	// everything a move writes to gets its full size
+	// here, clear() keeps the capacity afterwards
+	_length.resize(n_blks);
+	_tree.resize(n_blks + 1);
+	_pos.resize(n_blks);
+	_x_log.reserve(n_blks);
+	_y_log.reserve(n_blks);
+	_rotated.reserve(1);
+	_net_log.reserve(n_nets);
+	_dirty_nets.reserve(n_nets);
 }
 
 
@@ -152,22 +221,22 @@ void FloorPlanner::init_floorplan() {
 void FloorPlanner::simulated_annealing() {
 	double temperature = initial_temp;
 	bool frozen = false;
+	const double min_log_u = std::log(0x1.0p-53);
+
+	_curr_cost = cost();
+	std::size_t allocations = heap_allocations();
 
 	while (!frozen) {
 		int k = moves_per_temp;
 		while (k--) {
-			// cache previous sequence pair
+			// the move records what it changes
 			// so we could undo
-			std::vector<int> old_pos_seq = _pos_seq_pair;
-			std::vector<int> old_neg_seq = _neg_seq_pair;
-			std::vector<Match> old_match = _match;
-			std::vector<Match> old_match_x_rev = _match_x_rev;
-			std::vector<Macro> old_macros = _macros;
-			int old_bbox_w = _curr_bbox_w;
-			int old_bbox_h = _curr_bbox_h;
-			double old_cost = cost();
+			_last_move.bbox_w = _curr_bbox_w;
+			_last_move.bbox_h = _curr_bbox_h;
+			_last_move.hpwl = _curr_hpwl;
+			_last_move.cost = _curr_cost;
 
-			int move_choice = _uni_int_dist03(_rng);
+			int move_choice = _rng.below(4);
 
 			if (move_choice == 0) {
 				_swap_blks_pos();
@@ -183,6 +252,7 @@ void FloorPlanner::simulated_annealing() {
 			}
 			
 			_update_weighted_lcs();
+			sa_moves++;
 			
 			if (_curr_bbox_w <= chip_width && _curr_bbox_h <= chip_height) {
 				frozen = true;
@@ -191,7 +261,8 @@ void FloorPlanner::simulated_annealing() {
 				break;
 			}
 			
-			double delta = cost() - old_cost;
+			_curr_cost = cost();
+			double delta = _curr_cost - _last_move.cost;
 			
 			if (delta < 0) {
 				// accept_moves++;
@@ -201,19 +272,30 @@ void FloorPlanner::simulated_annealing() {
 				// _w_norm = accum_w / accept_moves;
 			}
 			else {
-				double uni_rand = _uni_real_dist(_rng);
-				double p = std::exp(static_cast<double>(-delta) / temperature);
+				// accept with probability exp(-delta / T), compared
+				// as logs: u > exp(x) is log(u) > x, and u >= 2^-53
+				// so anything below log(2^-53) is a sure reject
+				// that needs neither a draw nor a log; otherwise
+				// one draw, and log(u) only when x falls inside
+				// the bounds log_edges gives for u's 256th
+				double x = -delta / temperature;
+				bool reject = x < min_log_u;
+				if (!reject) {
+					std::uint64_t bits = _rng() >> 11;
+					double u = static_cast<double>(bits + 1) * 0x1.0p-53;
+					int slice = static_cast<int>(bits >> 45);
+					if (x <= log_edges.edge[slice]) {
+						reject = true;
+					}
+					else if (x < log_edges.edge[slice + 1]) {
+						reject = std::log(u) > x;
+					}
+				}
 					
-				if (uni_rand > p) {
+				if (reject) {
 					// reject!
 					// undo the move we just did
-					_pos_seq_pair = old_pos_seq;
-					_neg_seq_pair = old_neg_seq;
-					_match = old_match;
-					_match_x_rev = old_match_x_rev;
-					_macros = old_macros;
-					_curr_bbox_w = old_bbox_w;
-					_curr_bbox_h = old_bbox_h;
+					_undo_move();
 				}
 			
 			}
@@ -226,7 +308,8 @@ void FloorPlanner::simulated_annealing() {
 
 		temperature *= .95;
 	}
-	
+
+	sa_allocations += heap_allocations() - allocations;
 }
 
 int FloorPlanner::weighted_lcs(const std::vector<int>& seq_x, 
@@ -235,39 +318,36 @@ int FloorPlanner::weighted_lcs(const std::vector<int>& seq_x,
 		std::vector<Match>& match,
 		bool is_horizontal) {
 	// PRE-CONDITION: match is already updated
-	// and out_positions is cleared
+	if (is_horizontal) {
+		return _scan_kernel<true>(seq_x, match, out_positions);
+	}
+	return _scan_kernel<false>(seq_y, match, out_positions);
+}
 
-	// initialize length with size of n_blks
-	std::vector<int> length(n_blks, 0);	
+template <bool Horizontal>
+int FloorPlanner::_scan_kernel(const std::vector<int>& seq,
+		const std::vector<Match>& match,
+		std::vector<int>& out_positions) {
+	const std::vector<int>& size = Horizontal ? _blk_w : _blk_h;
+	std::vector<CoordRecord>& log = Horizontal ? _x_log : _y_log;
+	
+	std::fill(_length.begin(), _length.end(), 0);
 	for (int i = 0; i < n_blks; i++) {
-		int block, pos;
-		if (is_horizontal) {
-			block = seq_x[i];
-			pos = match[block].at_y;
-		}
-		else {
-			block = seq_y[i];
-			pos = match[block].at_x;
-		}
-		out_positions[block] = length[pos];
-		if (is_horizontal) {
-			_macros[block].x = out_positions[block];
-		}	
-		else {
-			_macros[block].y = out_positions[block];
+		int block = seq[i];
+		int pos = Horizontal ? match[block].at_y : match[block].at_x;
+
+		int len = _length[pos];
+		out_positions[block] = len;
+		int& coord = Horizontal ? _macros[block].x : _macros[block].y;
+		if (coord != len) {
+			log.emplace_back(block, coord);
+			coord = len;
 		}
 	
-		int t;
-		if (is_horizontal) {
-			t = out_positions[block] + _macros[block].w;
-		}
-		else {
-			t = out_positions[block] + _macros[block].h;
-		}
-
+		int t = len + size[block];
 		for (int j = pos; j < n_blks; j++) {
-			if (t > length[j]) {
-				length[j] = t;
+			if (t > _length[j]) {
+				_length[j] = t;
 			}
 			else {
 				break;
@@ -275,9 +355,63 @@ int FloorPlanner::weighted_lcs(const std::vector<int>& seq_x,
 		}
 	}
 	
-	return length[n_blks - 1];
+	return _length[n_blks - 1];
+}
+
+
+int FloorPlanner::fast_sp_lcs(const std::vector<int>& seq_x, 
+		const std::vector<int>& seq_y,
+		std::vector<int>& out_positions,
+		std::vector<Match>& match,
+		bool is_horizontal) {
+	// PRE-CONDITION: match is already updated
+	if (is_horizontal) {
+		return _fast_sp_kernel<true>(seq_x, match, out_positions);
+	}
+	return _fast_sp_kernel<false>(seq_y, match, out_positions);
 }
 
+template <bool Horizontal>
+int FloorPlanner::_fast_sp_kernel(const std::vector<int>& seq,
+		const std::vector<Match>& match,
+		std::vector<int>& out_positions) {
+	const std::vector<int>& size = Horizontal ? _blk_w : _blk_h;
+	std::vector<CoordRecord>& log = Horizontal ? _x_log : _y_log;
+
+	// _tree[i] (1-based) holds the max length over
+	// positions (i - lowbit(i), i]; lengths only
+	// grow during one call, so max works as the
+	// tree's "sum"
+	std::fill(_tree.begin(), _tree.end(), 0);
+	for (int i = 0; i < n_blks; i++) {
+		int block = seq[i];
+		int pos = Horizontal ? match[block].at_y : match[block].at_x;
+
+		// max length over positions before pos, what
+		// weighted_lcs finds in length[pos]
+		int len = 0;
+		for (int j = pos; j > 0; j -= j & -j) {
+			len = std::max(len, _tree[j]);
+		}
+		out_positions[block] = len;
+		int& coord = Horizontal ? _macros[block].x : _macros[block].y;
+		if (coord != len) {
+			log.emplace_back(block, coord);
+			coord = len;
+		}
+
+		int t = len + size[block];
+		for (int j = pos + 1; j <= n_blks; j += j & -j) {
+			_tree[j] = std::max(_tree[j], t);
+		}
+	}
+
+	int len = 0;
+	for (int j = n_blks; j > 0; j -= j & -j) {
+		len = std::max(len, _tree[j]);
+	}
+	return len;
+}
 
 void FloorPlanner::dump(std::ostream& os) const {
 	/*
@@ -300,6 +434,13 @@ void FloorPlanner::dump(std::ostream& os) const {
 	std::cout << "current chip area = " << _curr_bbox_w * _curr_bbox_h << "\n";
 	std::cout << "current cost = " << cost() << "\n";
 	std::cout << "current asp ratio = " << static_cast<double>(_curr_bbox_w) / _curr_bbox_h << "\n";
+#ifdef FP_COUNT_ALLOCATIONS
+	std::cout << "SA heap allocations = " << sa_allocations 
+		<< " (" << sa_moves << " moves)\n";
+#else
+	std::cout << "SA heap allocations = not counted, build with FP_COUNT_ALLOCATIONS"
+		<< " (" << sa_moves << " moves)\n";
+#endif
 	visualize();
 }
 
@@ -320,26 +461,147 @@ void FloorPlanner::write_result(std::ostream& os, double runtime) const {
 
 
 void FloorPlanner::_update_weighted_lcs() {
-	std::vector<int> pos;
-	pos.resize(n_blks);
-	// assign position to floorplan
-	_curr_bbox_w = weighted_lcs(_pos_seq_pair, _neg_seq_pair,
-			pos, _match, 1);
-	
-	std::vector<int> pos_seq_rev = _pos_seq_pair;
-	std::reverse(pos_seq_rev.begin(), pos_seq_rev.end());
-	
-	_curr_bbox_h = weighted_lcs(pos_seq_rev, _neg_seq_pair,
-			pos, _match_x_rev, 0);
+	_x_log.clear();
+	_y_log.clear();
+
+	// assign position to floorplan;
+	// the vertical pass walks the negative sequence and reads 
+	// the reversed positive one only through _match_x_rev
+	// (at_x = n_blks - 1 - index in _pos_seq_pair), so the
+	// reversed copy it used to get is never looked at
+	if (lcs_engine == LcsEngine::FAST_SP) {
+		_curr_bbox_w = _fast_sp_kernel<true>(_pos_seq_pair, _match, _pos);
+		_curr_bbox_h = _fast_sp_kernel<false>(_neg_seq_pair, _match_x_rev, _pos);
+	}
+	else {
+		_curr_bbox_w = _scan_kernel<true>(_pos_seq_pair, _match, _pos);
+		_curr_bbox_h = _scan_kernel<false>(_neg_seq_pair, _match_x_rev, _pos);
+	}
+
+	_update_hpwl();
+}
+
+void FloorPlanner::_update_hpwl() {
+	_net_log.clear();
+
+	if (static_cast<int>(_net_box.size()) != n_nets) {
+		_net_box.resize(n_nets);
+		_old_net_box.resize(n_nets);
+		_net_stamp.assign(n_nets, 0);
+		_net_dirty.assign(n_nets, 0);
+		_pin_count = 0;
+		for (const auto& net : _net_to_macros) {
+			_pin_count += net.size();
+		}
+		_measured_all = false;
+	}
+	else {
+		// one O(1) box update costs about as much as
+		// measuring 5 pins (on ami49 and random netlists)
+		int moved_pins = 0;
+		for (const auto& r : _x_log) {
+			moved_pins += _macro_to_nets[r.block].size();
+		}
+		for (const auto& r : _y_log) {
+			moved_pins += _macro_to_nets[r.block].size();
+		}
+		for (int blk : _rotated) {
+			moved_pins += 2 * _macro_to_nets[blk].size();
+		}
+		_measured_all = 5 * moved_pins > _pin_count;
+		if (!_measured_all) {
+			_update_moved_pins();
+			return;
+		}
+		_net_box.swap(_old_net_box);
+	}
+
+	_curr_hpwl = 0;
+	for (int net = 0; net < n_nets; net++) {
+		_net_box[net] = net_box(net);
+		_curr_hpwl += _net_box[net].hpwl();
+	}
+	_rotated.clear();
+}
+
+void FloorPlanner::_update_moved_pins() {
+	_stamp++;
+	_dirty_nets.clear();
+
+	// a rotated block's old pin isn't known from
+	// the logs, so its nets are measured again
+	for (int blk : _rotated) {
+		for (int net : _macro_to_nets[blk]) {
+			if (_net_dirty[net] != _stamp) {
+				_net_dirty[net] = _stamp;
+				_dirty_nets.push_back(net);
+				_touch_net(net);
+			}
+		}
+	}
+	_rotated.clear();
+
+	_update_net_boxes(_x_log, &Macro::x, &Macro::w, &NetBox::min_x, &NetBox::max_x);
+	_update_net_boxes(_y_log, &Macro::y, &Macro::h, &NetBox::min_y, &NetBox::max_y);
+
+	for (int net : _dirty_nets) {
+		_net_box[net] = net_box(net);
+	}
+
+	for (const auto& r : _net_log) {
+		_curr_hpwl += _net_box[r.net].hpwl() - r.box.hpwl();
+	}
+}
+
+void FloorPlanner::_update_net_boxes(const std::vector<CoordRecord>& log,
+	int Macro::* coord, int Macro::* size,
+	int NetBox::* min, int NetBox::* max) {
+	// pins move one at a time: the boxes hold the pins
+	// done so far at their new place and the others at
+	// their old one, so growing a box is exact and a pin
+	// moving inside it changes nothing, but a boundary
+	// pin moving inwards can't tell which pin is next in
+	// line and its net gets measured again
+	for (const auto& r : log) {
+		const Macro& m = _macros[r.block];
+		int old_pin = 2 * r.value + (m.*size - r.value);
+		int new_pin = 2 * (m.*coord) + (m.*size - m.*coord);
+
+		for (int net : _macro_to_nets[r.block]) {
+			const NetBox& box = _net_box[net];
+			if (_net_dirty[net] == _stamp) {
+				continue;
+			}
+			else if ((old_pin == box.*min && new_pin > old_pin) || 
+				(old_pin == box.*max && new_pin < old_pin)) {
+				_net_dirty[net] = _stamp;
+				_dirty_nets.push_back(net);
+				_touch_net(net);
+			}
+			else if (new_pin < box.*min) {
+				_touch_net(net).*min = new_pin;
+			}
+			else if (new_pin > box.*max) {
+				_touch_net(net).*max = new_pin;
+			}
+		}
+	}
 }
 
 void FloorPlanner::_swap_blks_pos() {
-	int blk_a = _uni_int_dist(_rng);
-	int blk_b = _uni_int_dist(_rng);
+	int blk_a = _random_blk();
+	int blk_b = _random_blk();
 	while (blk_b == blk_a) {
-		blk_b = _uni_int_dist(_rng);
+		blk_b = _random_blk();
 	}
 
+	_last_move.type = MoveType::SWAP_POS;
+	_last_move.a = blk_a;
+	_last_move.b = blk_b;
+	_swap_pos(blk_a, blk_b);
+}
+
+void FloorPlanner::_swap_pos(int blk_a, int blk_b) {
 	// swap blk_a and blk_b
 	std::swap(_pos_seq_pair[blk_a], _pos_seq_pair[blk_b]);
 
@@ -347,23 +609,27 @@ void FloorPlanner::_swap_blks_pos() {
 	_match[_pos_seq_pair[blk_b]].at_x = blk_b;
 	_match[_pos_seq_pair[blk_a]].at_x = blk_a;
 
-	int rev_blk_a = n_blks - 1 - blk_a;
-	int rev_blk_b = n_blks - 1 - blk_b;
-	std::vector<int> _pos_seq_pair_rev = _pos_seq_pair;
-	std::reverse(_pos_seq_pair_rev.begin(), _pos_seq_pair_rev.end());
-	_match_x_rev[_pos_seq_pair_rev[rev_blk_b]].at_x = rev_blk_b;
-	_match_x_rev[_pos_seq_pair_rev[rev_blk_a]].at_x = rev_blk_a;
-	
+	// index i of the sequence is index n_blks - 1 - i
+	// of the reversed one, no need to build it
+	_match_x_rev[_pos_seq_pair[blk_b]].at_x = n_blks - 1 - blk_b;
+	_match_x_rev[_pos_seq_pair[blk_a]].at_x = n_blks - 1 - blk_a;
 }
 
 
 void FloorPlanner::_swap_blks_neg() {
-	int blk_a = _uni_int_dist(_rng);
-	int blk_b = _uni_int_dist(_rng);
+	int blk_a = _random_blk();
+	int blk_b = _random_blk();
 	while (blk_b == blk_a) {
-		blk_b = _uni_int_dist(_rng);
+		blk_b = _random_blk();
 	}
 
+	_last_move.type = MoveType::SWAP_NEG;
+	_last_move.a = blk_a;
+	_last_move.b = blk_b;
+	_swap_neg(blk_a, blk_b);
+}
+
+void FloorPlanner::_swap_neg(int blk_a, int blk_b) {
 	// swap blk_a and blk_b
 	std::swap(_neg_seq_pair[blk_a], _neg_seq_pair[blk_b]);
 
@@ -371,21 +637,60 @@ void FloorPlanner::_swap_blks_neg() {
 	_match[_neg_seq_pair[blk_b]].at_y = blk_b;
 	_match[_neg_seq_pair[blk_a]].at_y = blk_a;
 	
-	int rev_blk_a = n_blks - 1 - blk_a;
-	int rev_blk_b = n_blks - 1 - blk_b;
-	std::vector<int> _neg_seq_pair_rev = _neg_seq_pair;
-	std::reverse(_neg_seq_pair_rev.begin(), _neg_seq_pair_rev.end());
-	_match_x_rev[_neg_seq_pair_rev[rev_blk_b]].at_y = rev_blk_b;
-	_match_x_rev[_neg_seq_pair_rev[rev_blk_a]].at_y = rev_blk_a;
-	
+	_match_x_rev[_neg_seq_pair[blk_b]].at_y = n_blks - 1 - blk_b;
+	_match_x_rev[_neg_seq_pair[blk_a]].at_y = n_blks - 1 - blk_a;
 }
 
 void FloorPlanner::_rotate_blk() {
-	int blk = _uni_int_dist(_rng);
+	int blk = _random_blk();
 
+	_last_move.type = MoveType::ROTATE;
+	_last_move.a = blk;
+	_rotate(blk);
+	_rotated.push_back(blk);
+}
+
+void FloorPlanner::_rotate(int blk) {
 	int tmp = _macros[blk].w;
 	_macros[blk].w = _macros[blk].h;
 	_macros[blk].h = tmp;
+	std::swap(_blk_w[blk], _blk_h[blk]);
+}
+
+void FloorPlanner::_undo_move() {
+	// every move is its own inverse
+	if (_last_move.type == MoveType::SWAP_POS) {
+		_swap_pos(_last_move.a, _last_move.b);
+	}
+	else if (_last_move.type == MoveType::SWAP_NEG) {
+		_swap_neg(_last_move.a, _last_move.b);
+	}
+	else {
+		_rotate(_last_move.a);
+	}
+
+	for (const auto& r : _x_log) {
+		_macros[r.block].x = r.value;
+	}
+	for (const auto& r : _y_log) {
+		_macros[r.block].y = r.value;
+	}
+	if (_measured_all) {
+		_net_box.swap(_old_net_box);
+	}
+	else {
+		for (const auto& r : _net_log) {
+			_net_box[r.net] = r.box;
+		}
+	}
+	_x_log.clear();
+	_y_log.clear();
+	_net_log.clear();
+
+	_curr_bbox_w = _last_move.bbox_w;
+	_curr_bbox_h = _last_move.bbox_h;
+	_curr_hpwl = _last_move.hpwl;
+	_curr_cost = _last_move.cost;
 }
 
 
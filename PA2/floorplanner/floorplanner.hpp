@@ -1,10 +1,13 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <random>
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include "rng.hpp"
 
 namespace floorplanner {
 
@@ -12,6 +15,15 @@ struct Block;
 struct Match;
 class FloorPlanner;
 
+// calls to the global operator new so far, counted
+// by the replacement in alloc_counter.cpp; always 0
+// unless built with FP_COUNT_ALLOCATIONS
+std::size_t heap_allocations();
+
+// seed for runs that don't pick one (see seed_rng),
+// different on every call; p is mixed in, e.g. this
+std::uint64_t random_seed(const void* p);
+
 enum class MacroType {
   BLOCK = 0,
   TERMINAL
@@ -39,9 +51,77 @@ struct Match {
 	}
 };
 
+// how a sequence pair is turned into coordinates
+enum class LcsEngine {
+	// weighted_lcs, O(n^2) in the worst case
+	SCAN = 0,
+	// fast_sp_lcs, O(n log n)
+	FAST_SP
+};
+
+enum class MoveType {
+	SWAP_POS = 0,
+	SWAP_NEG,
+	ROTATE
+};
+
+// what one SA move changed, enough to take it back
+struct MoveRecord {
+	MoveType type;
+	// swapped sequence indices, or the rotated block in a
+	int a, b;
+	// floorplan before the move
+	int bbox_w, bbox_h;
+	int hpwl;
+	double cost;
+};
+
+// bounding box of a net's pins (as hpwl() measures them)
+struct NetBox {
+	int min_x, max_x, min_y, max_y;
+
+	inline int hpwl() const {
+		return (max_x - min_x) + (max_y - min_y);
+	}
+};
+
+// a net's bounding box before the move being tried
+struct NetRecord {
+	int net;
+	NetBox box;
+
+	NetRecord() = default;
+	NetRecord(int net, const NetBox& box) :
+		net(net), box(box)
+	{
+	}
+};
+
+// a coordinate as it was before the last packing
+struct CoordRecord {
+	int block;
+	int value;
+
+	CoordRecord() = default;
+	CoordRecord(int block, int value) :
+		block(block), value(value)
+	{
+	}
+};
+
 class FloorPlanner {
 public:
   FloorPlanner();
+
+	/**
+	 * @brief seed_rng
+	 * restarts the random numbers of simulated annealing:
+	 * runs with the same seed and stream are identical,
+	 * different streams of one seed never overlap
+	 * (for runs in parallel); without a call every
+	 * FloorPlanner starts from a random seed
+	 */
+	void seed_rng(std::uint64_t seed, int stream = 0);
   /**
    * @brief read_input
    * reads input from *.block, *.nets files
@@ -61,7 +141,10 @@ public:
 	/**
 	 * @brief weighted_lcs
 	 * calculates the longest common subsequence(X, Y)
-	 * with block dimensions as weights
+	 * with block dimensions as weights;
+	 * horizontal walks seq_x with positions from match.at_y,
+	 * vertical walks seq_y with positions from match.at_x;
+	 * needs read_input first (for the scratch buffers)
 	 * reference: https://dl.acm.org/doi/pdf/10.1145/343647.343713
 	 */
 	int weighted_lcs(const std::vector<int>& seq_x, 
@@ -69,6 +152,21 @@ public:
 			std::vector<int>& out_position,
 			std::vector<Match>& match,
 			bool is_horizontal);
+
+	/**
+	 * @brief fast_sp_lcs
+	 * same as weighted_lcs (same arguments, coordinates
+	 * and result), but keeps the lengths in a binary
+	 * indexed tree over the positions, so a block's 
+	 * coordinate is a prefix-max query and its end an
+	 * O(log n) update instead of a linear scan
+	 * reference: FAST-SP, Tang and Wong, ASP-DAC 2001
+	 */
+	int fast_sp_lcs(const std::vector<int>& seq_x, 
+			const std::vector<int>& seq_y,
+			std::vector<int>& out_position,
+			std::vector<Match>& match,
+			bool is_horizontal);
 	
 
 	/**
@@ -78,8 +176,15 @@ public:
 	void simulated_annealing();
 
 
+	// the run statistics: hpwl, area, cost, aspect ratio and
+	// sa_allocations (counted only with FP_COUNT_ALLOCATIONS)
 	void dump(std::ostream& os) const;
 
+	// heap allocations (see heap_allocations) / moves
+	// over all simulated_annealing calls
+	std::size_t sa_allocations = 0;
+	long long sa_moves = 0;
+
 	void write_result(std::ostream& os, double runtime) const;
 
   inline int id_of(const std::string& name) {
@@ -98,6 +203,36 @@ public:
 		} while ((_curr_bbox_w > chip_width || _curr_bbox_h > chip_height) && passes < 10);
 	}
 	
+	/**
+	 * @brief net_box
+	 * calculates the bounding box of one net's pins
+	 */
+	inline NetBox net_box(int net) const {
+		NetBox box{std::numeric_limits<int>::max(), 0, 
+			std::numeric_limits<int>::max(), 0};
+		int llx, lly = 0;
+		
+		for (const auto& b : _net_to_macros[net]) {
+			const Macro& m = _macros[b];
+
+			if (m.type == MacroType::BLOCK) {
+				llx =	2 * m.x + (m.w - m.x);	
+				lly = 2 * m.y + (m.h - m.y);
+			}
+			else {
+				llx = 2 * m.x;
+				lly = 2 * m.y;
+			}
+
+			box.max_x = std::max(llx, box.max_x);
+			box.min_x = std::min(llx, box.min_x);
+			box.max_y = std::max(lly, box.max_y);
+			box.min_y = std::min(lly, box.min_y);
+		}
+
+		return box;
+	}
+
 	/**
 	 * @brief hpwl
 	 * calculates the total half-perimeter wire length
@@ -105,30 +240,8 @@ public:
 	 */
 	inline int hpwl() const {
 		int w = 0;
-		int llx, lly = 0;
-		for (const auto& net : _net_to_macros) {
-			int max_x = 0, min_x = std::numeric_limits<int>::max(); 
-			int max_y = 0, min_y = std::numeric_limits<int>::max();
-			
-			for (const auto& b : net) {
-				const Macro& m = _macros[b];
-
-				if (m.type == MacroType::BLOCK) {
-					llx =	2 * m.x + (m.w - m.x);	
-					lly = 2 * m.y + (m.h - m.y);
-				}
-				else {
-					llx = 2 * m.x;
-					lly = 2 * m.y;
-				}
-
-				max_x = std::max(llx, max_x);
-				min_x = std::min(llx, min_x);
-				max_y = std::max(lly, max_y);
-				min_y = std::min(lly, min_y);
-			}
-
-			w += ((max_x - min_x) + (max_y - min_y));
+		for (int net = 0; net < n_nets; net++) {
+			w += net_box(net).hpwl();
 		}
 
 		return w;
@@ -136,7 +249,8 @@ public:
 
 	/**
 	 * @brief cost
-	 * cost function = alpha * area + (1-alpha) * wirelength
+	 * cost function = alpha * area + (1-alpha) * wirelength,
+	 * with the wirelength _update_weighted_lcs keeps
 	 */
 	inline double cost() const {
 		// std::cout << "area = " << _curr_bbox_w * _curr_bbox_h << "\n";
@@ -147,7 +261,7 @@ public:
 		double asp_ratio_diff = std::abs(asp_ratio - _outline_asp_ratio); 
 
 	
-		return alpha * curr_area + (1 - alpha) * static_cast<double>(hpwl()) + 
+		return alpha * curr_area + (1 - alpha) * static_cast<double>(_curr_hpwl) + 
 					asp_ratio_diff * (curr_area / 2.5); 
 	}
 
@@ -183,6 +297,9 @@ public:
   double alpha;
 	double initial_temp;
 	int moves_per_temp;
+	// FAST_SP came out ahead even on hp's 11 blocks,
+	// SCAN is kept as the reference
+	LcsEngine lcs_engine = LcsEngine::FAST_SP;
 
 private:
 	
@@ -191,8 +308,49 @@ private:
 	void _update_match();
 
 	// update the largest common subsequence
+	// (and the wirelength with it)
 	void _update_weighted_lcs();
 
+	// the packing loops of weighted_lcs / fast_sp_lcs, one
+	// copy per direction: Horizontal walks seq with positions
+	// from match.at_y and places blocks by width in x, the
+	// other one uses at_x, heights and y
+	template <bool Horizontal>
+	int _scan_kernel(const std::vector<int>& seq,
+		const std::vector<Match>& match,
+		std::vector<int>& out_positions);
+
+	template <bool Horizontal>
+	int _fast_sp_kernel(const std::vector<int>& seq,
+		const std::vector<Match>& match,
+		std::vector<int>& out_positions);
+
+	// brings _net_box / _curr_hpwl up to date after a packing:
+	// a block pin that moved updates its nets' boxes in O(1),
+	// only a net whose boundary pin moved inwards, or that 
+	// has a rotated block, is measured again; when the moved
+	// pins reach a good part of all pins, measuring every
+	// net in one tight loop is cheaper and done instead
+	void _update_hpwl();
+
+	// the O(1) box updates of _update_hpwl
+	void _update_moved_pins();
+
+	// one dimension of _update_moved_pins, log holds the blocks'
+	// old coord (x or y) and size is the matching w or h
+	void _update_net_boxes(const std::vector<CoordRecord>& log,
+		int Macro::* coord, int Macro::* size,
+		int NetBox::* min, int NetBox::* max);
+
+	// logs a net's box the first time a packing changes it
+	inline NetBox& _touch_net(int net) {
+		if (_net_stamp[net] != _stamp) {
+			_net_stamp[net] = _stamp;
+			_net_log.emplace_back(net, _net_box[net]);
+		}
+		return _net_box[net];
+	}
+
 	// Move 1: swap 2 blocks in the positive sequence
 	void _swap_blks_pos();
 	
@@ -201,15 +359,36 @@ private:
 
 	// Move 3: change orientation
 	void _rotate_blk();
+
+	// the moves above with given indices, so they can be undone
+	void _swap_pos(int i, int j);
+	void _swap_neg(int i, int j);
+	void _rotate(int blk);
+
+	// takes back _last_move, including the
+	// coordinates the packing after it changed
+	void _undo_move();
 	
   std::unordered_map<std::string, int> _name_to_macro;
   std::vector<std::vector<int>> _net_to_macros;
+  std::vector<std::vector<int>> _macro_to_nets;
   
   // NOTE:
   // currenty both terminals and blocks are stored in _macros
   // so be cautious while floorplanning
   std::vector<Macro> _macros;
 
+	// block widths / heights packed for the packing loops,
+	// _rotate keeps them in step with _macros
+	std::vector<int> _blk_w, _blk_h;
+
+	// scratch space of the packing, sized once by read_input
+	// so a move doesn't allocate: the lengths of weighted_lcs,
+	// the tree of fast_sp_lcs and the positions they write
+	std::vector<int> _length;
+	std::vector<int> _tree;
+	std::vector<int> _pos;
+
   // sequence pairs
 	std::vector<int> _pos_seq_pair;
 	std::vector<int> _neg_seq_pair;
@@ -221,11 +400,13 @@ private:
 	double _outline_asp_ratio;
 
 
-  std::default_random_engine _rng;
-	std::random_device _rd;
-	std::uniform_int_distribution<int> _uni_int_dist;	
-	std::uniform_int_distribution<int> _uni_int_dist03;
-	std::uniform_real_distribution<double> _uni_real_dist;
+	Xoshiro256 _rng;
+
+	// a random block (index into the sequences)
+	inline int _random_blk() {
+		return static_cast<int>(_rng.below(n_blks));
+	}
+
 	// match list
 	// records which index the blocks is at
 	// in the positive / negative sequence
@@ -243,6 +424,38 @@ private:
 
 	// to early break SA
 	bool _in_bound = false;
+
+	// cost of the current floorplan, kept up to date by
+	// simulated_annealing so it's computed once per move
+	double _curr_cost;
+
+	// the move being tried
+	MoveRecord _last_move;
+
+	// old x / y of every block the last _update_weighted_lcs moved
+	std::vector<CoordRecord> _x_log, _y_log;
+
+	// blocks rotated since the last _update_hpwl
+	std::vector<int> _rotated;
+
+	// bounding box of every net and the sum of their
+	// hpwl, empty before the first packing
+	std::vector<NetBox> _net_box;
+	int _curr_hpwl = 0;
+	int _pin_count = 0;
+
+	// old box of every net the last _update_hpwl changed,
+	// or, if it measured all nets, all old boxes
+	std::vector<NetRecord> _net_log;
+	std::vector<NetBox> _old_net_box;
+	bool _measured_all = false;
+
+	// per _update_hpwl call: nets with _net_stamp == _stamp
+	// are in _net_log, the ones with _net_dirty == _stamp
+	// are also in _dirty_nets and measured again at the end
+	std::vector<int> _net_stamp, _net_dirty;
+	std::vector<int> _dirty_nets;
+	int _stamp = 0;
 };
 
 
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+
+namespace floorplanner {
+
+// xoshiro256** (Blackman and Vigna), the annealer's random 
+// numbers: a handful of shifts and xors per draw, and jump()
+// splits the period into 2^128 non-overlapping streams for
+// runs that go in parallel
+// reference: https://prng.di.unimi.it/xoshiro256starstar.c
+class Xoshiro256 {
+public:
+	explicit Xoshiro256(std::uint64_t seed = 0) {
+		this->seed(seed);
+	}
+
+	/**
+	 * @brief seed
+	 * fills the state from one 64 bit seed through
+	 * splitmix64, as the authors recommend
+	 */
+	void seed(std::uint64_t seed) {
+		for (auto& s : _s) {
+			seed += 0x9e3779b97f4a7c15ULL;
+			std::uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			s = z ^ (z >> 31);
+		}
+	}
+
+	inline std::uint64_t operator()() {
+		std::uint64_t result = _rotl(_s[1] * 5, 7) * 9;
+		std::uint64_t t = _s[1] << 17;
+
+		_s[2] ^= _s[0];
+		_s[3] ^= _s[1];
+		_s[1] ^= _s[2];
+		_s[0] ^= _s[3];
+		_s[2] ^= t;
+		_s[3] = _rotl(_s[3], 45);
+
+		return result;
+	}
+
+	/**
+	 * @brief below
+	 * uniform integer in [0, n), Lemire's nearly divisionless
+	 * method: a multiply and a shift, the division only comes
+	 * in for the rare draw that could be biased
+	 * reference: https://arxiv.org/abs/1805.10941
+	 */
+	inline std::uint32_t below(std::uint32_t n) {
+		std::uint64_t m = (operator()() >> 32) * n;
+		std::uint32_t low = static_cast<std::uint32_t>(m);
+		if (low < n) {
+			std::uint32_t threshold = -n % n;
+			while (low < threshold) {
+				m = (operator()() >> 32) * n;
+				low = static_cast<std::uint32_t>(m);
+			}
+		}
+		return static_cast<std::uint32_t>(m >> 32);
+	}
+
+	/**
+	 * @brief uniform
+	 * uniform double in (0, 1], from the top 53 bits, 
+	 * never 0 so its log is always finite
+	 */
+	inline double uniform() {
+		return static_cast<double>((operator()() >> 11) + 1) * 0x1.0p-53;
+	}
+
+	/**
+	 * @brief jump
+	 * advances the state by 2^128 draws, so streams
+	 * seeded alike and jumped 0, 1, 2... times apart
+	 * never overlap
+	 */
+	void jump() {
+		static const std::uint64_t poly[] = {
+			0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+			0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+		};
+
+		std::uint64_t s[4] = {0, 0, 0, 0};
+		for (std::uint64_t p : poly) {
+			for (int b = 0; b < 64; b++) {
+				if (p & (1ULL << b)) {
+					for (int i = 0; i < 4; i++) {
+						s[i] ^= _s[i];
+					}
+				}
+				operator()();
+			}
+		}
+		for (int i = 0; i < 4; i++) {
+			_s[i] = s[i];
+		}
+	}
+
+private:
+	static inline std::uint64_t _rotl(std::uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	std::uint64_t _s[4];
+};
+
+}
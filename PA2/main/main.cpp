@@ -4,11 +4,15 @@
 #include <fstream>
 
 int main(int argc, char* argv[]) {
-  if (argc != 5) {
-    std::cerr << "Usage: ./fp [alpha] [input.block] [input.net] [output.rpt]" << std::endl;
+  if (argc != 5 && argc != 6) {
+    std::cerr << "Usage: ./fp [alpha] [input.block] [input.net] [output.rpt] [seed]" << std::endl;
     std::exit(EXIT_FAILURE);
   }
 	floorplanner::FloorPlanner fp;
+	// same seed, same floorplan
+	if (argc == 6) {
+		fp.seed_rng(std::stoull(argv[5]));
+	}
 
   std::chrono::steady_clock::time_point start_time, end_time; 
   start_time = std::chrono::steady_clock::now(); 
@@ -0,0 +1,42 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <doctest.h>
+#include <floorplanner/floorplanner.hpp>
+#include <numeric>
+#include <random>
+
+// Unit test: FAST-SP packs exactly like the linear scan
+TEST_CASE("FastSP" * doctest::timeout(300)) {
+  floorplanner::FloorPlanner fp;
+  fp.read_input("0.5", "../../input_pa2/3.block", "../../input_pa2/3.nets");
+  int n = fp.n_blks;
+
+  std::mt19937 rng(5960);
+  std::vector<int> pos_seq(n), neg_seq(n);
+  std::iota(pos_seq.begin(), pos_seq.end(), 0);
+  std::iota(neg_seq.begin(), neg_seq.end(), 0);
+
+  for (int round = 0; round < 50; round++) {
+    std::shuffle(pos_seq.begin(), pos_seq.end(), rng);
+    std::shuffle(neg_seq.begin(), neg_seq.end(), rng);
+
+    // match lists as init_floorplan / the moves keep them
+    std::vector<floorplanner::Match> match(n), match_x_rev(n);
+    for (int i = 0; i < n; i++) {
+      match[pos_seq[i]].at_x = i;
+      match[neg_seq[i]].at_y = i;
+      match_x_rev[pos_seq[i]].at_x = n - 1 - i;
+      match_x_rev[neg_seq[i]].at_y = i;
+    }
+    std::vector<int> pos_seq_rev(pos_seq.rbegin(), pos_seq.rend());
+
+    std::vector<int> scan(n), fast(n);
+    REQUIRE(fp.weighted_lcs(pos_seq, neg_seq, scan, match, 1) ==
+      fp.fast_sp_lcs(pos_seq, neg_seq, fast, match, 1));
+    REQUIRE(scan == fast);
+
+    REQUIRE(fp.weighted_lcs(pos_seq_rev, neg_seq, scan, match_x_rev, 0) ==
+      fp.fast_sp_lcs(pos_seq_rev, neg_seq, fast, match_x_rev, 0));
+    REQUIRE(scan == fast);
+  }
+}
@@ -8,7 +8,7 @@ TEST_CASE("Parsing" * doctest::timeout(300)) {
   floorplanner::FloorPlanner fp;
   fp.read_input("0.72", "../../input_pa2/3.block", "../../input_pa2/3.nets");
     
-  REQUIRE(fp.alpha == 0.72f);
+  REQUIRE(fp.alpha == 0.72);
   REQUIRE(fp.chip_width == 16938);
   REQUIRE(fp.chip_height == 12668);
   REQUIRE(fp.n_blks == 103);